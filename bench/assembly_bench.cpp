@@ -0,0 +1,144 @@
+/* front end time per mesh: assemble_triangle on every triangle (each vertex transformed */
+/* once per use) against assemble_indexed (once per vertex, clipping only crossing */
+/* triangles), with the largest difference between their screen positions; then */
+/* assemble_indexed serial against pools of 1 to 4 threads, whose output must match bytewise */
+/* build with -DBUILD_BENCHMARKS=ON -DCMAKE_BUILD_TYPE=Release */
+#include "pipeline/primitive_assembler.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+static const int WIDTH = 800;
+static const int HEIGHT = 600;
+static const int RUNS = 5;
+
+/* wavy n x n quad grid, wider than the view so the triangles at its sides are clipped */
+static Mesh make_grid(int n) {
+    Mesh mesh;
+    mesh.name = "grid";
+    for (int j = 0; j <= n; j++) {
+        for (int i = 0; i <= n; i++) {
+            float x = 8.0f * i / n - 4.0f;
+            float z = 8.0f * j / n - 4.0f;
+            VertexInput v;
+            v.position = Vec3(x, 0.3f * std::sin(3.0f * x) * std::cos(2.0f * z), z);
+            v.normal = glm::normalize(Vec3(-0.9f * std::cos(3.0f * x) * std::cos(2.0f * z), 1.0f, 0.6f * std::sin(3.0f * x) * std::sin(2.0f * z)));
+            v.tex_coord = Vec2(static_cast<float>(i) / n, static_cast<float>(j) / n);
+            v.color = Color(1.0f);
+            mesh.vertices.push_back(v);
+        }
+    }
+    for (int j = 0; j < n; j++) {
+        for (int i = 0; i < n; i++) {
+            unsigned int a = j * (n + 1) + i;
+            unsigned int b = a + 1;
+            unsigned int c = a + n + 1;
+            unsigned int d = c + 1;
+            mesh.indices.insert(mesh.indices.end(), {a, c, b, b, c, d});
+        }
+    }
+    return mesh;
+}
+
+/* best time in milliseconds over RUNS calls */
+template <typename Assemble>
+static double best_ms(const Assemble& assemble) {
+    double best = 1e30;
+    for (int run = 0; run < RUNS; run++) {
+        auto start = std::chrono::steady_clock::now();
+        assemble();
+        best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+static void run(const Mesh& mesh, VertexProcessor& vertex_processor) {
+    Clipper clipper;
+    PrimitiveAssembler assembler;
+    std::vector<RasterVertex> per_triangle;
+    std::vector<RasterVertex> indexed;
+
+    double per_triangle_ms = best_ms([&]() {
+        per_triangle.clear();
+        for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3) {
+            assembler.assemble_triangle(mesh.vertices[mesh.indices[t]], mesh.vertices[mesh.indices[t + 1]],
+                                        mesh.vertices[mesh.indices[t + 2]], vertex_processor, clipper, WIDTH, HEIGHT, per_triangle);
+        }
+    });
+    double indexed_ms = best_ms([&]() {
+        indexed.clear();
+        assembler.assemble_indexed(mesh, vertex_processor, clipper, WIDTH, HEIGHT, indexed);
+    });
+
+    /* process_vertex and the batch transform round differently, so only nearly equal */
+    float largest = 0.0f;
+    if (per_triangle.size() == indexed.size()) {
+        for (size_t i = 0; i < indexed.size(); i++) {
+            for (int c = 0; c < 3; c++) {
+                largest = std::max(largest, std::abs(per_triangle[i].position[c] - indexed[i].position[c]));
+            }
+        }
+    }
+
+    std::cout << mesh.name << " (" << mesh.vertices.size() << " verts, " << mesh.triangle_count() << " tris): per-triangle "
+              << per_triangle_ms << " ms, indexed " << indexed_ms << " ms, ";
+    if (per_triangle.size() == indexed.size()) {
+        std::cout << indexed.size() / 3 << " tris out, max position difference " << largest << std::endl;
+    } else {
+        std::cout << "MISMATCH: " << per_triangle.size() / 3 << " vs " << indexed.size() / 3 << " tris out" << std::endl;
+    }
+}
+
+static bool same_bytes(const std::vector<RasterVertex>& a, const std::vector<RasterVertex>& b) {
+    return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(RasterVertex)) == 0;
+}
+
+static void run_pools(const Mesh& mesh, VertexProcessor& vertex_processor) {
+    Clipper clipper;
+    PrimitiveAssembler assembler;
+    std::vector<RasterVertex> serial;
+    std::vector<RasterVertex> pooled;
+
+    double serial_ms = best_ms([&]() {
+        serial.clear();
+        assembler.assemble_indexed(mesh, vertex_processor, clipper, WIDTH, HEIGHT, serial);
+    });
+    std::cout << mesh.name << " (" << mesh.triangle_count() << " tris): serial " << serial_ms << " ms";
+
+    for (int threads = 1; threads <= 4; threads++) {
+        ThreadPool pool(threads);
+        assembler.set_thread_pool(&pool);
+        double pool_ms = best_ms([&]() {
+            pooled.clear();
+            assembler.assemble_indexed(mesh, vertex_processor, clipper, WIDTH, HEIGHT, pooled);
+        });
+        assembler.set_thread_pool(nullptr);
+        std::cout << ", pool " << threads << " " << pool_ms << " ms" << (same_bytes(serial, pooled) ? "" : " (MISMATCH)");
+    }
+    std::cout << std::endl;
+}
+
+int main() {
+    VertexProcessor vertex_processor;
+    vertex_processor.set_viewport(WIDTH, HEIGHT);
+    vertex_processor.set_view_matrix(MatrixUtils::lookAt(Vec3(0.0f, 3.0f, 5.0f), Vec3(0.0f), Vec3(0.0f, 1.0f, 0.0f)));
+    vertex_processor.set_projection_matrix(MatrixUtils::perspective(glm::radians(60.0f), static_cast<float>(WIDTH) / HEIGHT, 0.1f, 100.0f));
+
+    std::cout << WIDTH << "x" << HEIGHT << " viewport, 1 thread, best of " << RUNS << std::endl;
+
+    /* about the size of the demo's teapot, then a 1M-vertex mesh */
+    Mesh small_grid = make_grid(91);
+    Mesh large_grid = make_grid(999);
+    run(small_grid, vertex_processor);
+    run(large_grid, vertex_processor);
+
+    std::cout << "assemble_indexed on " << std::thread::hardware_concurrency() << " hardware threads" << std::endl;
+    run_pools(small_grid, vertex_processor);
+    run_pools(large_grid, vertex_processor);
+
+    return 0;
+}
@@ -0,0 +1,149 @@
+/* fill rate on large floor triangles: the per-pixel from-scratch edge functions the */
+/* rasterizer started with against the set-up, incrementally stepped loop, and the */
+/* serial draw against the tiled parallel one (serial too when the pool has one thread) */
+/* build with -DBUILD_BENCHMARKS=ON -DCMAKE_BUILD_TYPE=Release */
+#include "framebuffer.h"
+#include "pipeline/rasterizer.h"
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+static const int WIDTH = 1920;
+static const int HEIGHT = 1080;
+static const int RUNS = 20;
+
+struct LambertShader {
+    Vec3 light_dir;
+
+    Color operator()(const Fragment& frag) const {
+        float n_dot_l = std::max(glm::dot(frag.normal, light_dir), 0.0f);
+        return frag.color * n_dot_l;
+    }
+};
+
+static float edge_function(Vec2 a, Vec2 b, Vec2 c) {
+    return (c.x - a.x) * (b.y - a.y) - (c.y - a.y) * (b.x - a.x);
+}
+
+/* the original loop: three edge functions per pixel of the bounding box, from scratch */
+template <typename Shader>
+static uint64_t draw_from_scratch(FrameBuffer& framebuffer, const RasterVertex& v0, const RasterVertex& v1, const RasterVertex& v2, const Shader& shader) {
+    Vec2 p0 = Vec2(v0.position.x, v0.position.y);
+    Vec2 p1 = Vec2(v1.position.x, v1.position.y);
+    Vec2 p2 = Vec2(v2.position.x, v2.position.y);
+    float area = edge_function(p0, p1, p2);
+    if (std::abs(area) < 0.0001f) {
+        return 0;
+    }
+
+    int min_x = std::max(static_cast<int>(std::floor(std::min({p0.x, p1.x, p2.x}))), 0);
+    int min_y = std::max(static_cast<int>(std::floor(std::min({p0.y, p1.y, p2.y}))), 0);
+    int max_x = std::min(static_cast<int>(std::ceil(std::max({p0.x, p1.x, p2.x}))), framebuffer.get_width() - 1);
+    int max_y = std::min(static_cast<int>(std::ceil(std::max({p0.y, p1.y, p2.y}))), framebuffer.get_height() - 1);
+    float inv_area = 1.0f / area;
+    uint64_t shaded = 0;
+
+    for (int y = min_y; y <= max_y; y++) {
+        for (int x = min_x; x <= max_x; x++) {
+            Vec2 p = Vec2(x + 0.5f, y + 0.5f);
+            float w0 = edge_function(p1, p2, p) * inv_area;
+            float w1 = edge_function(p2, p0, p) * inv_area;
+            float w2 = edge_function(p0, p1, p) * inv_area;
+            if (w0 < 0 || w1 < 0 || w2 < 0) continue;
+
+            float depth = w0 * v0.position.z + w1 * v1.position.z + w2 * v2.position.z;
+            if (depth >= framebuffer.get_depth(x, y)) continue;
+
+            Vec3 weights = Vec3(w0 * v0.inv_w, w1 * v1.inv_w, w2 * v2.inv_w);
+            weights /= weights.x + weights.y + weights.z;
+            Fragment frag;
+            frag.screen_pos = Vec3(x, y, depth);
+            frag.world_pos = v0.world_pos * weights.x + v1.world_pos * weights.y + v2.world_pos * weights.z;
+            frag.normal = v0.normal * weights.x + v1.normal * weights.y + v2.normal * weights.z;
+            frag.tex_coord = v0.tex_coord * weights.x + v1.tex_coord * weights.y + v2.tex_coord * weights.z;
+            frag.color = v0.color * weights.x + v1.color * weights.y + v2.color * weights.z;
+
+            framebuffer.set_pixel(x, y, shader(frag));
+            framebuffer.set_depth(x, y, depth);
+            shaded++;
+        }
+    }
+    return shaded;
+}
+
+static RasterVertex make_vertex(float x, float y, float z, float inv_w) {
+    RasterVertex v;
+    v.position = Vec3(x, y, z);
+    v.world_pos = Vec3(x, 0.0f, y);
+    v.normal = Vec3(0.0f, 0.0f, 1.0f);
+    v.tex_coord = Vec2(x / WIDTH, y / HEIGHT);
+    v.color = Color(0.3f, 0.7f, 0.3f, 1.0f);
+    v.inv_w = inv_w;
+    return v;
+}
+
+/* best rate over RUNS draws into a freshly cleared depth buffer, draw returns fragments */
+template <typename Draw>
+static double best_rate(FrameBuffer& framebuffer, const Draw& draw) {
+    double best = 0.0;
+    for (int run = 0; run < RUNS; run++) {
+        framebuffer.clear_depth(1.0f);
+        auto start = std::chrono::steady_clock::now();
+        uint64_t fragments = draw();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = std::max(best, static_cast<double>(fragments) / seconds);
+    }
+    return best;
+}
+
+int main() {
+    FrameBuffer framebuffer(WIDTH, HEIGHT);
+    Rasterizer rasterizer;
+    rasterizer.set_framebuffer(&framebuffer);
+    rasterizer.set_backface_culling(false);
+    rasterizer.set_quad_shading(false);
+
+    /* a ground quad in perspective: narrow and far at the horizon, wide and near at the bottom */
+    std::vector<RasterVertex> floor = {
+        make_vertex(WIDTH * 0.35f, HEIGHT * 0.45f, 0.95f, 0.1f),
+        make_vertex(WIDTH * 0.65f, HEIGHT * 0.45f, 0.95f, 0.1f),
+        make_vertex(WIDTH * 1.6f, HEIGHT, 0.2f, 1.0f),
+        make_vertex(WIDTH * 0.35f, HEIGHT * 0.45f, 0.95f, 0.1f),
+        make_vertex(WIDTH * 1.6f, HEIGHT, 0.2f, 1.0f),
+        make_vertex(WIDTH * -0.6f, HEIGHT, 0.2f, 1.0f)
+    };
+    LambertShader shader{glm::normalize(Vec3(0.3f, 0.4f, 1.0f))};
+
+    auto rasterizer_fragments = [&]() {
+        RasterStats stats = rasterizer.get_stats();
+        rasterizer.reset_stats();
+        return stats.fragments_shaded;
+    };
+
+    double scratch_rate = best_rate(framebuffer, [&]() {
+        return draw_from_scratch(framebuffer, floor[0], floor[1], floor[2], shader)
+             + draw_from_scratch(framebuffer, floor[3], floor[4], floor[5], shader);
+    });
+
+    rasterizer.set_num_threads(1);
+    double serial_rate = best_rate(framebuffer, [&]() {
+        rasterizer.draw_triangle(floor[0], floor[1], floor[2], shader);
+        rasterizer.draw_triangle(floor[3], floor[4], floor[5], shader);
+        return rasterizer_fragments();
+    });
+
+    rasterizer.set_num_threads(0);
+    double parallel_rate = best_rate(framebuffer, [&]() {
+        rasterizer.draw_triangles_parallel(floor, shader);
+        return rasterizer_fragments();
+    });
+
+    std::cout << WIDTH << "x" << HEIGHT << " floor quad, best of " << RUNS << ", quad shading off" << std::endl;
+    std::cout << "from-scratch edge functions, 1 thread: " << scratch_rate / 1e6 << " Mfrag/s" << std::endl;
+    std::cout << "stepped edge functions, 1 thread:      " << serial_rate / 1e6 << " Mfrag/s" << std::endl;
+    std::cout << "draw_triangles_parallel, " << rasterizer.get_thread_pool().get_num_threads() << " thread(s):  "
+              << parallel_rate / 1e6 << " Mfrag/s" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,93 @@
+/* triangles/sec on dense screen-space meshes with the small-triangle fast path off and on */
+/* build with -DBUILD_BENCHMARKS=ON -DCMAKE_BUILD_TYPE=Release */
+#include "framebuffer.h"
+#include "pipeline/rasterizer.h"
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+static const int WIDTH = 800;
+static const int HEIGHT = 600;
+static const int RUNS = 30;
+
+struct LambertShader {
+    Vec3 light_dir;
+
+    Color operator()(const Fragment& frag) const {
+        float n_dot_l = std::max(glm::dot(frag.normal, light_dir), 0.0f);
+        return frag.color * n_dot_l;
+    }
+};
+
+/* lat/long sphere projected orthographically onto the screen, 2 * rings * segments triangles */
+static std::vector<RasterVertex> make_sphere(int rings, int segments) {
+    const float pi = 3.14159265358979f;
+    float radius = HEIGHT * 0.45f;
+    Vec3 center = Vec3(WIDTH * 0.5f, HEIGHT * 0.5f, 0.5f);
+
+    auto point = [&](int ring, int segment) {
+        float theta = pi * ring / rings;
+        float phi = 2.0f * pi * segment / segments;
+        Vec3 normal = Vec3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+        RasterVertex v;
+        v.position = Vec3(center.x + normal.x * radius, center.y - normal.y * radius, center.z - normal.z * 0.4f);
+        v.world_pos = normal;
+        v.normal = normal;
+        v.tex_coord = Vec2(static_cast<float>(segment) / segments, static_cast<float>(ring) / rings);
+        v.color = Color(0.8f, 0.8f, 0.8f, 1.0f);
+        v.inv_w = 1.0f;
+        return v;
+    };
+
+    std::vector<RasterVertex> vertices;
+    vertices.reserve(static_cast<size_t>(rings) * segments * 6);
+    for (int r = 0; r < rings; r++) {
+        for (int s = 0; s < segments; s++) {
+            RasterVertex a = point(r, s), b = point(r + 1, s), c = point(r + 1, s + 1), d = point(r, s + 1);
+            vertices.insert(vertices.end(), {a, d, c, a, c, b});
+        }
+    }
+    return vertices;
+}
+
+/* best triangles/sec over RUNS draws into a freshly cleared depth buffer */
+template <typename Shader>
+static double best_rate(Rasterizer& rasterizer, FrameBuffer& framebuffer, const std::vector<RasterVertex>& vertices, const Shader& shader) {
+    double best = 0.0;
+    for (int run = 0; run < RUNS; run++) {
+        framebuffer.clear_depth(1.0f);
+        auto start = std::chrono::steady_clock::now();
+        rasterizer.draw_triangles_parallel(vertices, shader);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = std::max(best, static_cast<double>(vertices.size() / 3) / seconds);
+    }
+    return best;
+}
+
+int main() {
+    FrameBuffer framebuffer(WIDTH, HEIGHT);
+    Rasterizer rasterizer;
+    rasterizer.set_framebuffer(&framebuffer);
+    rasterizer.set_num_threads(1);
+    rasterizer.set_backface_culling(false);
+    LambertShader shader{glm::normalize(Vec3(0.3f, 0.4f, 1.0f))};
+
+    std::cout << WIDTH << "x" << HEIGHT << " screen-space sphere, 1 thread, best of " << RUNS << std::endl;
+
+    /* about 4 pixels, 1 pixel and a quarter pixel per triangle */
+    const int sizes[][2] = {{128, 256}, {256, 512}, {512, 1024}};
+    for (const auto& size : sizes) {
+        std::vector<RasterVertex> vertices = make_sphere(size[0], size[1]);
+
+        rasterizer.set_small_triangle_path(false);
+        double block_walk = best_rate(rasterizer, framebuffer, vertices, shader);
+        rasterizer.set_small_triangle_path(true);
+        double fast_path = best_rate(rasterizer, framebuffer, vertices, shader);
+
+        std::cout << vertices.size() / 3 / 1000 << "k triangles: block walk " << block_walk / 1e6
+                  << " M/s, small-triangle path " << fast_path / 1e6 << " M/s" << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,89 @@
+/* fragments/sec of the pixel loop: std::function vs shader-type dispatch, */
+/* each with the scalar and the AVX2 span kernel */
+/* build with -DBUILD_BENCHMARKS=ON -DCMAKE_BUILD_TYPE=Release */
+#include "framebuffer.h"
+#include "pipeline/rasterizer.h"
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+static const int WIDTH = 1920;
+static const int HEIGHT = 1080;
+static const int RUNS = 20;
+
+/* trivial N.L shader, cheap enough that the pixel loop dominates */
+struct LambertShader {
+    Vec3 light_dir;
+
+    Color operator()(const Fragment& frag) const {
+        float n_dot_l = std::max(glm::dot(frag.normal, light_dir), 0.0f);
+        return frag.color * n_dot_l;
+    }
+};
+
+static RasterVertex make_vertex(float x, float y, float z) {
+    RasterVertex v;
+    v.position = Vec3(x, y, z);
+    v.world_pos = Vec3(x, y, z);
+    v.normal = glm::normalize(Vec3(x / WIDTH - 0.5f, y / HEIGHT - 0.5f, 1.0f));
+    v.tex_coord = Vec2(x / WIDTH, y / HEIGHT);
+    v.color = Color(0.8f, 0.6f, 0.4f, 1.0f);
+    v.inv_w = 1.0f;
+    return v;
+}
+
+/* best fragments/sec over RUNS draws into a freshly cleared depth buffer */
+template <typename Draw>
+static double best_rate(Rasterizer& rasterizer, FrameBuffer& framebuffer, const Draw& draw) {
+    double best = 0.0;
+    for (int run = 0; run < RUNS; run++) {
+        framebuffer.clear_depth(1.0f);
+        rasterizer.reset_stats();
+        auto start = std::chrono::steady_clock::now();
+        draw();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = std::max(best, static_cast<double>(rasterizer.get_stats().fragments_shaded) / seconds);
+    }
+    return best;
+}
+
+int main() {
+    FrameBuffer framebuffer(WIDTH, HEIGHT);
+    Rasterizer rasterizer;
+    rasterizer.set_framebuffer(&framebuffer);
+    rasterizer.set_num_threads(1);
+    rasterizer.set_backface_culling(false);
+
+    /* one screen-filling quad */
+    std::vector<RasterVertex> vertices = {
+        make_vertex(0, 0, 0.5f), make_vertex(WIDTH, 0, 0.5f), make_vertex(WIDTH, HEIGHT, 0.5f),
+        make_vertex(0, 0, 0.5f), make_vertex(WIDTH, HEIGHT, 0.5f), make_vertex(0, HEIGHT, 0.5f)
+    };
+
+    LambertShader shader{glm::normalize(Vec3(0.3f, 0.4f, 1.0f))};
+    rasterizer.set_fragment_shader(shader);
+
+    std::cout << WIDTH << "x" << HEIGHT << " quad, 1 thread, best of " << RUNS
+              << (rasterizer.is_quad_shading() ? ", quad shading" : "") << std::endl;
+
+    for (int simd = 0; simd < 2; simd++) {
+        rasterizer.set_simd_enabled(simd == 1);
+        if (simd == 1 && !rasterizer.is_simd_enabled()) {
+            std::cout << "avx2:   not supported on this CPU" << std::endl;
+            continue;
+        }
+
+        double function_rate = best_rate(rasterizer, framebuffer, [&]() {
+            rasterizer.draw_triangles_parallel(vertices);
+        });
+        double template_rate = best_rate(rasterizer, framebuffer, [&]() {
+            rasterizer.draw_triangles_parallel(vertices, shader);
+        });
+
+        std::cout << (simd == 1 ? "avx2:   " : "scalar: ")
+                  << "std::function " << function_rate / 1e6 << " Mfrag/s, "
+                  << "template " << template_rate / 1e6 << " Mfrag/s" << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,85 @@
+/* vertex transform of a 1M-vertex mesh: the per-vertex process_vertex loop against the */
+/* batch process_vertices, scalar and AVX2, with the largest difference from the loop */
+/* build with -DBUILD_BENCHMARKS=ON -DCMAKE_BUILD_TYPE=Release */
+#include "pipeline/vertex_processor.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+static const size_t VERTICES = 1000000;
+static const int RUNS = 20;
+
+/* best time in milliseconds over RUNS calls */
+template <typename Transform>
+static double best_ms(const Transform& transform) {
+    double best = 1e30;
+    for (int run = 0; run < RUNS; run++) {
+        auto start = std::chrono::steady_clock::now();
+        transform();
+        best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+static float max_difference(const std::vector<VertexOutput>& reference, const std::vector<ClipVertex>& batch) {
+    float largest = 0.0f;
+    for (size_t i = 0; i < reference.size(); i++) {
+        for (int c = 0; c < 4; c++) {
+            largest = std::max(largest, std::abs(reference[i].clip_pos[c] - batch[i].clip_pos[c]));
+        }
+        for (int c = 0; c < 3; c++) {
+            largest = std::max(largest, std::abs(reference[i].world_pos[c] - batch[i].world_pos[c]));
+            largest = std::max(largest, std::abs(reference[i].normal[c] - batch[i].normal[c]));
+        }
+    }
+    return largest;
+}
+
+int main() {
+    /* random points and unit normals in a unit cube, seen through a typical camera */
+    std::mt19937 rng(12345);
+    std::uniform_real_distribution<float> coordinate(-1.0f, 1.0f);
+    std::vector<VertexInput> inputs(VERTICES);
+    for (VertexInput& v : inputs) {
+        v.position = Vec3(coordinate(rng), coordinate(rng), coordinate(rng));
+        v.normal = glm::normalize(Vec3(coordinate(rng), coordinate(rng), coordinate(rng)) + Vec3(0.0f, 0.0f, 1e-3f));
+        v.tex_coord = Vec2(coordinate(rng), coordinate(rng));
+        v.color = Color(1.0f);
+    }
+
+    VertexProcessor vertex_processor;
+    vertex_processor.set_viewport(800, 600);
+    vertex_processor.set_model_matrix(MatrixUtils::translate(Vec3(0.5f, -0.2f, 0.0f)) * MatrixUtils::rotateY(0.7f)
+                                      * MatrixUtils::scale(Vec3(2.0f, 1.0f, 1.5f)));
+    vertex_processor.set_view_matrix(MatrixUtils::lookAt(Vec3(0.0f, 2.0f, 6.0f), Vec3(0.0f), Vec3(0.0f, 1.0f, 0.0f)));
+    vertex_processor.set_projection_matrix(MatrixUtils::perspective(glm::radians(60.0f), 800.0f / 600.0f, 0.1f, 100.0f));
+
+    std::vector<VertexOutput> reference(VERTICES);
+    std::vector<ClipVertex> batch(VERTICES);
+
+    double loop_ms = best_ms([&]() {
+        for (size_t i = 0; i < VERTICES; i++) {
+            reference[i] = vertex_processor.process_vertex(inputs[i]);
+        }
+    });
+
+    vertex_processor.set_simd_enabled(false);
+    double scalar_ms = best_ms([&]() { vertex_processor.process_vertices(inputs.data(), VERTICES, batch.data()); });
+    float scalar_error = max_difference(reference, batch);
+
+    vertex_processor.set_simd_enabled(true);
+    bool avx2 = vertex_processor.is_simd_enabled();
+    double simd_ms = best_ms([&]() { vertex_processor.process_vertices(inputs.data(), VERTICES, batch.data()); });
+    float simd_error = max_difference(reference, batch);
+
+    std::cout << VERTICES / 1000 << "k vertices, 1 thread, best of " << RUNS << std::endl;
+    std::cout << "process_vertex loop:       " << loop_ms << " ms" << std::endl;
+    std::cout << "process_vertices scalar:   " << scalar_ms << " ms, max error " << scalar_error << std::endl;
+    std::cout << "process_vertices " << (avx2 ? "AVX2:     " : "(no AVX2):") << simd_ms << " ms, max error "
+              << simd_error << std::endl;
+
+    return 0;
+}
@@ -18,7 +18,15 @@ class FrameBuffer {
         std::vector<Color> color_buffer;
         std::vector<float> depth_buffer;
 
+        /* hierarchical Z: conservative (never too small) max depth per block */
+        std::vector<float> block_max_depth;
+        int blocks_x;
+        int blocks_y;
+
     public:
+        /* block size of the coarse max-depth buffer */
+        static constexpr int DEPTH_BLOCK_SIZE = 8;
+
         /* constructor */
         FrameBuffer(int i_width, int i_height);
 
@@ -34,6 +42,9 @@ class FrameBuffer {
         /* set pixel with blending */
         void set_pixel_blended(int x, int y, Color color, BlendMode mode);
 
+        /* blend a source color over a destination color */
+        static Color blend(Color src, Color dst, BlendMode mode);
+
         /* get pixel color at (x, y) */
         Color get_pixel(int x, int y);
 
@@ -46,9 +57,20 @@ class FrameBuffer {
         /* depth test: returns true if new_depth is closer, also updates buffer */
         bool depth_test(int x, int y, float new_depth);
 
+        /* coarse max depth of block (bx, by), anything at or behind it is occluded */
+        float get_block_max_depth(int bx, int by);
+
+        /* recompute the exact max depth of a block after depth writes */
+        void refresh_block_max_depth(int bx, int by);
+
+        /* copy depth and coarse max depth from a framebuffer of the same size */
+        void copy_depth(const FrameBuffer& source);
+
         /* getters */
         int get_width();
         int get_height();
         std::vector<Color>& get_color_buffer();
-        std::vector<float>& get_depth_buffer();
+        std::vector<float>& get_depth_buffer();   /* direct writes must refresh touched blocks */
+        int get_blocks_x();
+        int get_blocks_y();
 };
\ No newline at end of file
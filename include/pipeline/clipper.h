@@ -1,7 +1,8 @@
 #pragma once
 
 #include "math/vector.h"
-#include <vector>
+#include "pipeline/varyings.h"
+#include <cstdint>
 
 /* clip planes in clip space */
 enum class ClipPlane {
@@ -14,6 +15,7 @@ enum class ClipPlane {
 };
 
 /* vertex with clip space position and attributes for interpolation */
+/* every attribute is stored; a draw's varying set limits which are interpolated */
 struct ClipVertex {
     Vec4 clip_pos;      /* position in clip space */
     Vec3 world_pos;     /* world position for lighting */
@@ -24,8 +26,9 @@ struct ClipVertex {
 
 class Clipper {
     private:
-        /* clip a polygon against a single plane */
-        std::vector<ClipVertex> clip_polygon_against_plane(const std::vector<ClipVertex>& vertices, ClipPlane plane);
+        /* clip a polygon of count vertices against a single plane into out (room for */
+        /* MAX_POLYGON_VERTICES), returns the output vertex count */
+        int clip_polygon_against_plane(const ClipVertex* vertices, int count, ClipPlane plane, uint32_t varyings, ClipVertex* out);
 
         /* check if a point is inside a specific clip plane */
         bool is_inside_plane(const Vec4& clip_pos, ClipPlane plane);
@@ -33,20 +36,33 @@ class Clipper {
         /* compute intersection parameter t where edge crosses clip plane */
         float intersect_plane(const ClipVertex& v0, const ClipVertex& v1, ClipPlane plane);
 
-        /* interpolate vertex attributes at parameter t */
-        ClipVertex interpolate_vertex(const ClipVertex& v0, const ClipVertex& v1, float t);
+        /* interpolate the position and the attributes in a varying set at parameter t, */
+        /* attributes outside the set are zero */
+        ClipVertex interpolate_vertex(const ClipVertex& v0, const ClipVertex& v1, float t, uint32_t varyings);
 
     public:
         /* constructor */
         Clipper();
 
-        /* clip a triangle against all frustum planes */
-        /* returns clipped vertices (0, 3, 6, ... for 0, 1, 2, ... triangles) */
-        std::vector<ClipVertex> clip_triangle(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2);
+        /* each plane adds at most one vertex to a convex polygon: 3 + 6 after clipping, */
+        /* fanned into at most 7 triangles; in float, vertices near frustum corners can */
+        /* classify inconsistently and add more, those beyond the limit are dropped */
+        static constexpr int MAX_POLYGON_VERTICES = 9;
+        static constexpr int MAX_CLIPPED_VERTICES = (MAX_POLYGON_VERTICES - 2) * 3;
+
+        /* clip a triangle against all frustum planes into out (room for MAX_CLIPPED_VERTICES) */
+        /* returns the vertex count (0, 3, 6, ... for 0, 1, 2, ... triangles), never allocates */
+        /* new vertices get only the attributes in varyings, the draw's shader_varyings */
+        int clip_triangle(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2, ClipVertex* out,
+                          uint32_t varyings = Varyings::ALL);
 
         /* check if a point is inside the view frustum */
         bool is_inside_frustum(const Vec4& clip_pos);
 
+        /* one bit per ClipPlane the point is outside of, 0 inside the frustum */
+        /* a triangle is outside if its codes share a bit and needs clipping only if one is set */
+        uint32_t outcode(const Vec4& clip_pos);
+
         /* check if a triangle is completely outside (trivial reject) */
         bool is_triangle_outside(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2);
 };
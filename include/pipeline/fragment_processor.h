@@ -87,6 +87,13 @@ class FragmentProcessor {
         /* constructor */
         FragmentProcessor();
 
+        /* varyings read by process_fragment: texture coordinates only when the material has a map */
+        static constexpr uint32_t UNTEXTURED_VARYINGS = Varyings::WORLD_POS | Varyings::NORMAL | Varyings::COLOR;
+        static constexpr uint32_t TEXTURED_VARYINGS = UNTEXTURED_VARYINGS | Varyings::TEX_COORD;
+
+        /* whether the current material samples a texture (and needs TEXTURED_VARYINGS) */
+        bool uses_textures() const;
+
         /* light management */
         void add_light(const Light& light);
         void clear_lights();
@@ -105,7 +112,42 @@ class FragmentProcessor {
         /* process a fragment and return final color (fragment shader) */
         Color process_fragment(const Fragment& fragment);
 
+        /* shade the live lanes of a 2x2 quad into colors[lane] (packet fragment shader) */
+        void process_quad(const FragmentQuad& quad, Color* colors);
+
         /* shading modes */
         Color shade_flat(const Fragment& fragment);
         Color shade_phong(const Fragment& fragment);
 };
+
+/* shader-type adapter: the rasterizer calls the quad overload once per 2x2 quad */
+/* the textured set asks for derivatives (mip selection), the untextured one does not */
+template <uint32_t Set>
+struct BasicFragmentProcessorShader {
+    static constexpr uint32_t varyings = Set;
+    static constexpr bool derivatives = (Set & Varyings::TEX_COORD) != 0;
+    FragmentProcessor& processor;
+
+    Color operator()(const Fragment& frag) const {
+        return processor.process_fragment(frag);
+    }
+
+    void operator()(const FragmentQuad& quad, Color* colors) const {
+        processor.process_quad(quad, colors);
+    }
+};
+
+using FragmentProcessorShader = BasicFragmentProcessorShader<FragmentProcessor::TEXTURED_VARYINGS>;
+using UntexturedFragmentProcessorShader = BasicFragmentProcessorShader<FragmentProcessor::UNTEXTURED_VARYINGS>;
+
+/* per-draw adapter for draw_objects_sort_last: processors[draw_id] shades the draw's */
+/* fragments, with the textured set and derivatives since any draw may sample a texture */
+struct DrawFragmentProcessorShader {
+    static constexpr uint32_t varyings = FragmentProcessor::TEXTURED_VARYINGS;
+    static constexpr bool derivatives = true;
+    std::vector<FragmentProcessor>& processors;
+
+    Color operator()(uint32_t draw_id, const Fragment& frag) const {
+        return processors[draw_id].process_fragment(frag);
+    }
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "math/vector.h"
+#include "model_loader.h"
+#include "pipeline/vertex_processor.h"
+#include "pipeline/clipper.h"
+#include "pipeline/rasterizer.h"
+#include "thread_pool.h"
+#include <vector>
+#include <cstdint>
+
+/* convert a vertex processor output to a clipper vertex */
+ClipVertex to_clip_vertex(const VertexOutput& v);
+
+/* perspective divide and viewport transform of a clipper vertex */
+RasterVertex to_raster_vertex(const ClipVertex& cv, int viewport_width, int viewport_height);
+
+/* front end between the vertex processor and the rasterizer: turns meshes into */
+/* clipped screen-space triangles (3 RasterVertex each) */
+class PrimitiveAssembler {
+    private:
+        /* post-transform buffers, one entry per mesh vertex (reused across draws) */
+        std::vector<ClipVertex> transformed;    /* clip space, the input of the clipper */
+        std::vector<RasterVertex> projected;    /* screen space, for triangles that need no clipping */
+        std::vector<uint32_t> outcodes;         /* Clipper::outcode of each vertex */
+
+        /* parallel front end: worker pool (nullptr = serial) and per-chunk assembled triangles */
+        ThreadPool* thread_pool;
+        std::vector<std::vector<RasterVertex>> chunk_vertices;
+
+        /* assemble and clip triangles [first, last) of a transformed mesh, appending to out */
+        void assemble_range(const Mesh& mesh, Clipper& clipper, size_t first, size_t last,
+                            int width, int height, uint32_t varyings, std::vector<RasterVertex>& out);
+
+    public:
+        /* constructor */
+        PrimitiveAssembler();
+
+        /* vertices per task of the parallel vertex stage, triangles per assembly chunk */
+        static constexpr size_t VERTEX_GRAIN = 4096;
+        static constexpr size_t TRIANGLE_CHUNK = 4096;
+
+        /* run the vertex stage and assembly on a worker pool, e.g. the rasterizer's */
+        void set_thread_pool(ThreadPool* pool);
+
+        /* indexed draw: every vertex of the mesh is transformed and projected once, then */
+        /* triangles are assembled by index; only those crossing a frustum plane are clipped */
+        /* with a pool, vertices are split across threads and triangles are assembled in */
+        /* TRIANGLE_CHUNK ranges whose outputs are concatenated in order, so the result */
+        /* does not depend on the number of threads */
+        /* varyings is the set of the shader that will draw the result (shader_varyings), */
+        /* clipped vertices interpolate only those attributes */
+        void assemble_indexed(const Mesh& mesh, VertexProcessor& vertex_processor, Clipper& clipper,
+                              int width, int height, std::vector<RasterVertex>& raster_vertices,
+                              uint32_t varyings = Varyings::ALL);
+
+        /* immediate mode: transform and clip one triangle, its vertices are not shared */
+        void assemble_triangle(const VertexInput& v0, const VertexInput& v1, const VertexInput& v2,
+                               VertexProcessor& vertex_processor, Clipper& clipper,
+                               int width, int height, std::vector<RasterVertex>& raster_vertices,
+                               uint32_t varyings = Varyings::ALL);
+};
@@ -2,11 +2,15 @@
 
 #include "math/vector.h"
 #include "framebuffer.h"
+#include "pipeline/shadow_map.h"
+#include "pipeline/varyings.h"
+#include "thread_pool.h"
 #include <functional>
 #include <vector>
-#include <thread>
-#include <mutex>
+#include <memory>
 #include <atomic>
+#include <cstdint>
+#include <type_traits>
 
 /* vertex data for rasterization (screen space) */
 struct RasterVertex {
@@ -15,20 +19,215 @@ struct RasterVertex {
     Vec3 normal;        /* normal vector */
     Vec2 tex_coord;     /* texture coordinates */
     Color color;        /* vertex color */
+    float inv_w = 1.0f; /* 1 / clip-space w, for perspective-correct interpolation */
 };
 
-/* interpolated fragment data */
+/* screen-space derivatives of the interpolated attributes: change per pixel step */
+struct FragmentDerivatives {
+    Vec3 world_pos = Vec3(0.0f);
+    Vec3 normal = Vec3(0.0f);
+    Vec2 tex_coord = Vec2(0.0f);
+    Color color = Color(0.0f);
+};
+
+/* interpolated fragment data, attributes outside the shader's varying set are zero */
 struct Fragment {
     Vec3 screen_pos;    /* screen x, y and depth z */
     Vec3 world_pos;     /* interpolated world position */
-    Vec3 normal;        /* interpolated normal */
+    Vec3 normal;        /* interpolated normal (not renormalized) */
     Vec2 tex_coord;     /* interpolated texture coordinates */
     Color color;        /* interpolated vertex color */
+    FragmentDerivatives ddx;    /* along x, from the fragment's 2x2 quad (zero if not quad-shaded) */
+    FragmentDerivatives ddy;    /* along y */
+};
+
+/* a 2x2 pixel quad handed to packet shaders: lanes in row order (x, y), (x+1, y), */
+/* (x, y+1), (x+1, y+1); lanes outside mask are helpers, interpolated for the */
+/* derivatives only and never written */
+struct FragmentQuad {
+    Fragment fragments[4];
+    uint32_t mask;
+};
+
+/* depth comparison a fragment must pass against the stored depth */
+enum class DepthFunc {
+    LESS,           /* nearer than the stored depth (default) */
+    EQUAL           /* exactly the stored depth, for shading after a depth prepass */
 };
 
 /* fragment shader callback type */
 using FragmentShader = std::function<Color(const Fragment&)>;
 
+/* adapter giving a FragmentShader the shader-type interface (vertex color if unset) */
+struct FunctionShader {
+    const FragmentShader& shader;
+
+    Color operator()(const Fragment& frag) const {
+        return shader ? shader(frag) : frag.color;
+    }
+};
+
+/* shaders may add operator()(const FragmentQuad&, Color* out) to be called once per */
+/* quad, filling out[lane] for the live lanes; others are called per live fragment */
+template <typename Shader>
+constexpr bool is_quad_shader = std::is_invocable_v<const Shader&, const FragmentQuad&, Color*>;
+
+/* shaders reading Fragment::ddx/ddy declare a static constexpr bool derivatives = true */
+/* member and are shaded in 2x2 quads; the rest are shaded alone with zero derivatives */
+template <typename Shader, typename = void>
+struct shader_derivatives {
+    static constexpr bool value = false;
+};
+
+template <typename Shader>
+struct shader_derivatives<Shader, std::void_t<decltype(Shader::derivatives)>> {
+    static constexpr bool value = Shader::derivatives;
+};
+
+/* gives a shader (a lambda, say) a varying set: with_varyings<Varyings::NORMAL>(shader), */
+/* and derivatives too with with_varyings<Varyings::TEX_COORD, true>(shader) */
+template <uint32_t Set, typename Shader, bool Derivatives = shader_derivatives<Shader>::value>
+struct VaryingShader {
+    static constexpr uint32_t varyings = Set;
+    static constexpr bool derivatives = Derivatives;
+    Shader shader;
+
+    Color operator()(const Fragment& frag) const {
+        return shader(frag);
+    }
+
+    template <typename S = Shader, typename = std::enable_if_t<is_quad_shader<S>>>
+    void operator()(const FragmentQuad& quad, Color* colors) const {
+        shader(quad, colors);
+    }
+};
+
+template <uint32_t Set, typename Shader>
+VaryingShader<Set, Shader> with_varyings(Shader shader) {
+    return VaryingShader<Set, Shader>{shader};
+}
+
+template <uint32_t Set, bool Derivatives, typename Shader>
+VaryingShader<Set, Shader, Derivatives> with_varyings(Shader shader) {
+    return VaryingShader<Set, Shader, Derivatives>{shader};
+}
+
+/* deferred shader for visibility-buffer resolve: draw id passed at draw time, plus fragment */
+using VisibilityShader = std::function<Color(uint32_t draw_id, const Fragment&)>;
+
+/* per-triangle data computed once before rasterization */
+struct TriangleSetup {
+    const RasterVertex* v0;
+    const RasterVertex* v1;
+    const RasterVertex* v2;
+    /* integer edge functions of the snapped vertices, edge i opposite vertex i, */
+    /* oriented so inside is >= 0, with the top-left fill rule bias folded into the origin */
+    int64_t edge_dx[3];     /* change per pixel step in x */
+    int64_t edge_dy[3];     /* change per pixel step in y */
+    int64_t edge_origin[3]; /* values at the center of pixel (min_x, min_y) */
+    float depth_dx;     /* change of depth per pixel step in x */
+    float depth_dy;     /* change of depth per pixel step in y */
+    float depth_origin; /* depth at the center of pixel (min_x, min_y) */
+    float min_depth;    /* nearest vertex depth, for hierarchical Z */
+
+    /* multisampling: edge and depth offsets from the pixel center to each sample, and */
+    /* the extremes of the edge offsets so blocks are classified over every sample (0 at 1x) */
+    int64_t sample_edge_offset[3][4];
+    int64_t sample_min_offset[3];
+    int64_t sample_max_offset[3];
+    float sample_depth_offset[4];
+
+    /* plane equations of 1/w followed by the varyings of the draw's set divided by w, */
+    /* packed at Varyings::offset: world_pos (3), normal (3), tex_coord (2), color (4) */
+    static constexpr int NUM_VARYINGS = Varyings::count(Varyings::ALL);
+    float varying_origin[NUM_VARYINGS]; /* values at the center of pixel (min_x, min_y) */
+    float varying_dx[NUM_VARYINGS];     /* change per pixel step in x */
+    float varying_dy[NUM_VARYINGS];     /* change per pixel step in y */
+    int min_x;          /* screen bounding box, clipped to framebuffer */
+    int min_y;
+    int max_x;
+    int max_y;
+    uint32_t triangle_id;   /* id written to the visibility buffer */
+    bool small;             /* bounds fit the small-triangle footprint, rasterized by the fast path */
+    uint16_t small_coverage;    /* small triangles: covered pixel centers, bit (y - min_y) * 4 + (x - min_x) */
+};
+
+/* barycentric planes of a set-up triangle, used to derive depth and attribute planes */
+struct BarycentricPlanes {
+    Vec3 dx;
+    Vec3 dy;
+    Vec3 origin;        /* at the center of pixel (min_x, min_y) */
+};
+
+/* depth buffer written by depth-only draws */
+struct DepthTarget {
+    float* depth;               /* width * height depths, row-major */
+    int width;
+    int height;
+    FrameBuffer* framebuffer;   /* owner of the hierarchical Z to test and keep current, or nullptr */
+    bool multisample;           /* depth holds MSAA_SAMPLES depths per pixel, interleaved by pixel */
+};
+
+/* a block of a triangle that survived classification, handed to the per-block action */
+struct RasterBlock {
+    int block_x;        /* block coordinates, in BLOCK_SIZE units */
+    int block_y;
+    int x0;             /* pixels of the block inside the triangle's rectangle (inclusive) */
+    int y0;
+    int x1;
+    int y1;
+    int64_t w_row[3];   /* edge values at (x0, y0), stepped by the action row by row */
+    float depth_row;    /* depth at (x0, y0) */
+    bool fully_inside;  /* every pixel (every sample, multisampled) is inside all edges */
+};
+
+/* one unit of parallel raster work: a screen tile or, for heavy tiles, a part of one */
+struct TileTask {
+    uint32_t tile;      /* index of the tile bin holding the triangles */
+    int min_x;          /* pixel rectangle covered by the task (inclusive) */
+    int min_y;
+    int max_x;
+    int max_y;
+};
+
+/* rasterization counters, accumulated until reset */
+struct RasterStats {
+    uint64_t blocks_rejected;   /* blocks fully outside the triangle, skipped */
+    uint64_t blocks_accepted;   /* blocks fully inside, no per-pixel coverage test */
+    uint64_t blocks_partial;    /* blocks crossing an edge, tested per pixel */
+    uint64_t blocks_occluded;   /* blocks behind the hierarchical Z max depth */
+    uint64_t tiles_occluded;    /* triangle/tile pairs dropped by hierarchical Z during binning */
+    uint64_t triangles_occluded;/* triangles dropped from every tile they overlap */
+    uint64_t fragments_shaded;  /* fragment shader invocations */
+    uint64_t fragments_written; /* fragments that passed the depth test and were written */
+    uint64_t depth_fragments;   /* depth-only draws: fragments that passed and stored their depth */
+
+    RasterStats() :
+        blocks_rejected(0),
+        blocks_accepted(0),
+        blocks_partial(0),
+        blocks_occluded(0),
+        tiles_occluded(0),
+        triangles_occluded(0),
+        fragments_shaded(0),
+        fragments_written(0),
+        depth_fragments(0)
+    {}
+
+    /* add counters from another set (e.g. a worker thread) */
+    void merge(const RasterStats& other) {
+        blocks_rejected += other.blocks_rejected;
+        blocks_accepted += other.blocks_accepted;
+        blocks_partial += other.blocks_partial;
+        blocks_occluded += other.blocks_occluded;
+        tiles_occluded += other.tiles_occluded;
+        triangles_occluded += other.triangles_occluded;
+        fragments_shaded += other.fragments_shaded;
+        fragments_written += other.fragments_written;
+        depth_fragments += other.depth_fragments;
+    }
+};
+
 class Rasterizer {
     private:
         FrameBuffer* framebuffer;
@@ -37,19 +236,249 @@ class Rasterizer {
         bool backface_culling;
         BlendMode blend_mode;
         bool depth_write;
+        DepthFunc depth_func;
         int num_threads;
-        std::mutex framebuffer_mutex;
+        ThreadPool thread_pool;
+        bool simd_enabled;
+        bool early_depth_test;
+        bool quad_shading;
+        bool small_triangle_path;
+        RasterStats stats;
+
+        /* tile binning state for parallel rendering (reused across calls) */
+        std::vector<TriangleSetup> triangle_setups;
+        std::vector<std::vector<uint32_t>> tile_bins;
+        std::vector<float> tile_max_depth;
+        std::vector<uint32_t> tile_cost;    /* estimated pixels to test per tile (bounding box overlap) */
+        std::vector<TileTask> tile_tasks;
+        int tiles_x;
+        int tiles_y;
+        int bin_width;      /* size of the target being binned */
+        int bin_height;
+
+        /* visibility buffer state (deferred shading mode) */
+        bool visibility_pass;
+        std::vector<uint32_t> visibility_buffer;        /* per-pixel triangle id */
+        std::vector<RasterVertex> visibility_vertices;  /* 3 vertices per stored triangle */
+        std::vector<uint32_t> visibility_draw_ids;      /* draw id per stored triangle */
+        std::vector<uint8_t> visibility_derivatives;    /* per draw id: resolve computes ddx/ddy */
+
+        /* packed depth+color state (lock-free unordered opaque mode) */
+        bool packed_pass;
+        std::unique_ptr<std::atomic<uint64_t>[]> packed_buffer;    /* per-pixel depth bits << 32 | RGBA8 */
+        size_t packed_size;
+
+        /* weighted blended order-independent transparency state */
+        bool oit_pass;
+        std::vector<Color> oit_accumulation;    /* sum of weighted premultiplied color (rgb) and weighted alpha (a) */
+        std::vector<float> oit_revealage;       /* product of (1 - alpha), the background still visible */
+
+        /* multisample state: MSAA_SAMPLES colors and depths per pixel, interleaved by pixel */
+        bool msaa_enabled;
+        std::vector<Color> sample_color;
+        std::vector<float> sample_depth;
+
+        /* sort-last state: private color + depth per worker thread, merged by depth */
+        std::vector<std::unique_ptr<FrameBuffer>> thread_targets;
+        std::vector<uint8_t> thread_target_used;    /* targets written by the current sort-last draw */
+        std::vector<std::vector<uint32_t>> thread_draw_ids; /* draw id behind each target pixel, for depth ties */
 
         /* calculate edge function for point against edge */
         float edge_function(Vec2 a, Vec2 b, Vec2 c);
 
-        /* interpolate fragment attributes using barycentric coordinates */
+        /* interpolate fragment attributes using screen-space barycentric coordinates (perspective-corrected) */
         Fragment interpolate_fragment(Vec3 bary, const RasterVertex& v0, const RasterVertex& v1, const RasterVertex& v2, Vec3 screen_pos);
 
-        /* thread-safe pixel write */
-        void write_pixel_safe(int x, int y, float depth, const Color& color);
+        /* evaluate the varying planes of a triangle set up for Set at a pixel */
+        template <uint32_t Set>
+        Fragment interpolate_varyings(const TriangleSetup& setup, int x, int y, float depth) const;
+
+        /* plane values of a set at a pixel: seeded once per row or quad, then stepped by */
+        /* setup.varying_dx/dy per pixel (one add per plane instead of a full evaluation) */
+        template <uint32_t Set>
+        static void seed_varyings(const TriangleSetup& setup, int x, int y, float* planes);
+        template <uint32_t Set>
+        static void step_varyings(const float* step, float* planes);
+
+        /* perspective-correct fragment from plane values of a set at a pixel */
+        template <uint32_t Set>
+        static Fragment varyings_fragment(const float* planes, int x, int y, float depth);
+
+        /* cull, snap and compute bounding box, edges and depth plane for a width x height target */
+        /* returns false if the triangle is rejected */
+        /* multisample extends the box and sample offsets to the MSAA sample pattern */
+        bool setup_edges(const Vec3& p0, const Vec3& p1, const Vec3& p2, int width, int height, bool multisample, TriangleSetup& setup, BarycentricPlanes& bary);
+
+        /* setup_edges for the framebuffer plus the planes of the varyings in a set */
+        bool setup_triangle(const RasterVertex& v0, const RasterVertex& v1, const RasterVertex& v2, uint32_t varyings, TriangleSetup& setup);
+
+        /* coverage/depth lane mask for one span (AVX2 or scalar kernel) */
+        uint32_t span_mask(const TriangleSetup& setup, const int64_t* w, float depth, const float* depth_row, int count, bool fully_inside, bool test_depth, DepthFunc func) const;
+
+        /* per-pixel depth test and hierarchical Z rejection for a depth function */
+        static bool depth_passes(DepthFunc func, float depth, float stored);
+        static bool depth_occluded(DepthFunc func, float min_depth, float max_depth);
+
+        /* packed words: depth bits order like the depth (non-negative floats), so the */
+        /* smallest word holds the nearest fragment; equal depths keep the smaller color */
+        static uint32_t pack_depth(float depth);
+        static uint32_t pack_color(Color color);
+        static Color unpack_color(uint32_t packed);
+
+        /* depth of a pixel in a small triangle's footprint, shared by the color and depth-only paths */
+        /* so both produce bit-identical values for equal depth tests */
+        static float small_triangle_depth(const TriangleSetup& setup, int dx, int dy);
+
+        /* covered samples of pixel i of a block row, one bit per sample, shared by the color */
+        /* and depth-only multisampled paths like small_triangle_depth */
+        static uint32_t sample_coverage(const TriangleSetup& setup, const RasterBlock& block, int i);
+
+        /* edge values at (x0, y0) and block classification, false if the block is outside an edge */
+        bool classify_block(const TriangleSetup& setup, int x0, int y0, int x1, int y1, int64_t* w_row, bool& fully_inside) const;
+
+        /* walk the BLOCK_SIZE x BLOCK_SIZE blocks of a triangle inside a rectangle (inclusive): */
+        /* blocks outside an edge, or behind occlusion's hierarchical Z under depth_func when */
+        /* it is given, are counted and skipped; action(block) handles the rest and returns */
+        /* whether it wrote depth, which refreshes that block of refresh when it is given */
+        template <typename BlockAction>
+        void for_each_block(const TriangleSetup& setup, int rect_min_x, int rect_min_y, int rect_max_x, int rect_max_y, FrameBuffer* occlusion, DepthFunc func, FrameBuffer* refresh, RasterStats& counters, const BlockAction& action) const;
+
+        /* one row of framebuffer depth blocks per parallel task: rows(y0, y1) processes */
+        /* pixel rows [y0, y1) and the row's hierarchical Z is refreshed afterwards in place */
+        template <typename RowAction>
+        void for_each_depth_block_row(const RowAction& rows);
+
+        /* branch-free coverage of the whole footprint of a small triangle */
+        uint16_t small_coverage_mask(const TriangleSetup& setup) const;
+
+        /* rasterize a set-up triangle restricted to a screen rectangle (inclusive) */
+        /* blocks are classified against the edges before any pixel is tested */
+        template <typename Shader>
+        void rasterize_triangle(const TriangleSetup& setup, FrameBuffer& target, int rect_min_x, int rect_min_y, int rect_max_x, int rect_max_y, RasterStats& counters, const Shader& shader);
+
+        /* fast path for triangles within a SMALL_TRIANGLE_SIZE square: coverage is known from setup, */
+        /* only the depth test and shading remain */
+        template <typename Shader>
+        void rasterize_small_triangle(const TriangleSetup& setup, FrameBuffer& target, int rect_min_x, int rect_min_y, int rect_max_x, int rect_max_y, RasterStats& counters, const Shader& shader);
+
+        /* shade one covered pixel and keep it in its packed word if it is the nearest so far */
+        template <typename Shader>
+        void shade_packed_pixel(int x, int y, float depth, const float* planes, RasterStats& counters, const Shader& shader);
+
+        /* make one private target per thread, sized like the framebuffer */
+        void begin_sort_last();
+
+        /* merge the used private targets into the framebuffer, the nearest depth wins */
+        void composite_sort_last();
+
+        /* add a transparent fragment to the OIT buffers, weighted by coverage and depth */
+        void accumulate_oit(int x, int y, Color color, float depth);
+
+        /* multisampled block walk: coverage and depth per sample, shading once per pixel */
+        template <typename Shader>
+        void rasterize_triangle_msaa(const TriangleSetup& setup, int rect_min_x, int rect_min_y, int rect_max_x, int rect_max_y, RasterStats& counters, const Shader& shader);
+
+        /* depth test the covered samples of a pixel, shade it once and write the passing samples */
+        /* (planes: the shader's plane values at the pixel center, see seed_varyings) */
+        template <typename Shader>
+        void shade_samples(const TriangleSetup& setup, int x, int y, float depth, const float* planes, uint32_t coverage, RasterStats& counters, const Shader& shader);
+
+        /* interpolate, shade and write one covered pixel (depth tested after shading if early-Z is off) */
+        /* (planes: the shader's plane values at the pixel, see seed_varyings) */
+        template <typename Shader>
+        void shade_pixel(const TriangleSetup& setup, FrameBuffer& target, int x, int y, float depth, const float* planes, RasterStats& counters, const Shader& shader);
+
+        /* late depth test, then blend or accumulate a shaded color and write its depth */
+        void write_fragment(FrameBuffer& target, int x, int y, float depth, Color color, RasterStats& counters);
+
+        /* attribute differences between two fragments of one triangle (to - from) */
+        template <uint32_t Set = Varyings::ALL>
+        static FragmentDerivatives attribute_delta(const Fragment& from, const Fragment& to);
+
+        /* walk 2x2 quads over row coverage masks whose bit 0 is column origin_x, row 0 is */
+        /* origin_y (both even); quads with no live pixel are skipped, depth_at(x, y) gives */
+        /* the depth of any lane, helper lanes included */
+        template <typename Shader, typename DepthAt>
+        void shade_quads(const TriangleSetup& setup, FrameBuffer& target, int origin_x, int origin_y, const uint32_t* row_masks, int rows, const DepthAt& depth_at, RasterStats& counters, const Shader& shader);
+
+        /* interpolate all four lanes of a quad, derive ddx/ddy, shade and write the live lanes */
+        template <typename Shader, typename DepthAt>
+        void shade_quad(const TriangleSetup& setup, FrameBuffer& target, int x, int y, uint32_t mask, const DepthAt& depth_at, RasterStats& counters, const Shader& shader);
+
+        /* whether color draws of a shader go through the quad path (only shaders that */
+        /* declare derivatives, never for ids or packed words) */
+        template <typename Shader>
+        bool quad_path() const;
+
+        /* reset the tile grid for a width x height target, tile depth from hiz if given */
+        void begin_binning(int width, int height, FrameBuffer* hiz);
+
+        /* append a set-up triangle to the tiles its bounding box overlaps */
+        void bin_setup(const TriangleSetup& setup);
+
+        /* set up triangles for a varying set and assign them to the framebuffer tiles they overlap */
+        void bin_triangles(const RasterVertex* vertices, size_t num_triangles, uint32_t first_triangle_id, uint32_t varyings);
+
+        /* turn the tile bins into tile tasks */
+        void build_tile_tasks();
+
+        /* depth-only rasterization of one triangle restricted to a rectangle (inclusive) */
+        void rasterize_depth_triangle(const TriangleSetup& setup, int rect_min_x, int rect_min_y, int rect_max_x, int rect_max_y, const DepthTarget& target, RasterStats& counters);
+
+        /* depth-only counterpart of rasterize_triangle_msaa, into a multisampled target */
+        void rasterize_depth_triangle_msaa(const TriangleSetup& setup, int rect_min_x, int rect_min_y, int rect_max_x, int rect_max_y, const DepthTarget& target, RasterStats& counters);
+
+        /* depth-only counterpart of rasterize_small_triangle */
+        void rasterize_small_depth_triangle(const TriangleSetup& setup, int rect_min_x, int rect_min_y, int rect_max_x, int rect_max_y, const DepthTarget& target, RasterStats& counters);
+
+        /* bin and rasterize positions into a depth target on the worker pool */
+        void draw_depth(const std::vector<Vec3>& positions, const DepthTarget& target);
+
+        /* rasterize the binned triangles as tile tasks, heavy tiles split into sub-tiles */
+        template <typename Shader>
+        void rasterize_tiles(const Shader& shader);
 
     public:
+        /* screen tile size in pixels used for parallel binning */
+        static constexpr int TILE_SIZE = 64;
+
+        /* heavy tiles are split into sub-tiles of this size so idle threads can steal them */
+        static constexpr int SUBTILE_SIZE = TILE_SIZE / 2;
+        static constexpr uint32_t HEAVY_TILE_COST = 4 * TILE_SIZE * TILE_SIZE;
+
+        /* triangles per parallel task in the packed mode, which has no tiles */
+        static constexpr size_t PACKED_BATCH = 64;
+
+        /* visibility buffer value for pixels not covered by any triangle */
+        static constexpr uint32_t VISIBILITY_EMPTY = 0xFFFFFFFFu;
+
+        /* sort-last draw id for target pixels no draw wrote, loses every tie */
+        static constexpr uint32_t SORT_LAST_EMPTY = 0xFFFFFFFFu;
+
+        /* pixels tested together by the coverage/depth kernel */
+        static constexpr int SPAN_WIDTH = 8;
+
+        /* vertices are snapped to 1 / 2^SUBPIXEL_BITS of a pixel (16.8 fixed point) */
+        static constexpr int SUBPIXEL_BITS = 8;
+
+        /* samples per pixel in multisample mode, in a rotated grid at 1/16 pixel offsets */
+        /* from the center: (-2, -6), (6, -2), (-6, 2), (2, 6) */
+        static constexpr int MSAA_SAMPLES = 4;
+
+        /* triangles whose bounds fit this many pixels per side take the small-triangle path */
+        static constexpr int SMALL_TRIANGLE_SIZE = 4;
+
+        /* hierarchical Z margin for equal depth tests, well above interpolation rounding */
+        static constexpr float EQUAL_DEPTH_SLACK = 1.0f / 65536.0f;
+
+        /* block size for hierarchical trivial accept/reject (one span per block row), */
+        /* shared with the framebuffer's hierarchical Z blocks */
+        static constexpr int BLOCK_SIZE = SPAN_WIDTH;
+        static_assert(BLOCK_SIZE == FrameBuffer::DEPTH_BLOCK_SIZE, "raster blocks must match depth blocks");
+        static_assert(TILE_SIZE % BLOCK_SIZE == 0, "tiles must hold whole blocks");
+        static_assert(SUBTILE_SIZE % BLOCK_SIZE == 0, "sub-tiles must hold whole blocks");
+        static_assert(SMALL_TRIANGLE_SIZE * SMALL_TRIANGLE_SIZE <= 16, "small-triangle coverage must fit 16 bits");
+
         /* constructor */
         Rasterizer();
 
@@ -71,15 +500,121 @@ class Rasterizer {
         /* enable/disable depth writing (disable for transparent objects) */
         void set_depth_write(bool enabled);
 
+        /* set the depth comparison of color draws (depth-only draws always use LESS) */
+        /* EQUAL after draw_depth_only of the same triangles shades each visible pixel once */
+        void set_depth_func(DepthFunc func);
+
+        /* enable/disable the AVX2 coverage kernel (stays off if the CPU lacks AVX2) */
+        void set_simd_enabled(bool enabled);
+        bool is_simd_enabled() const;
+
+        /* enable/disable depth testing before shading (default on) */
+        /* safe in the tiled parallel path since each tile's pixels have a single writer */
+        void set_early_depth_test(bool enabled);
+
+        /* enable/disable shading in 2x2 quads (default on) for shaders that declare */
+        /* derivatives (shader_derivatives): every pixel is shaded with its quad neighbours */
+        /* interpolated alongside, so Fragment::ddx/ddy hold finite differences of the */
+        /* attributes; off, and for every other shader, pixels are shaded alone with zero */
+        /* derivatives (the visibility resolve derives them per draw from the same triangle */
+        /* at x+1 and y+1; multisampled draws still shade single pixels) */
+        void set_quad_shading(bool enabled);
+        bool is_quad_shading() const;
+
+        /* enable/disable the small-triangle fast path (default on); off, every triangle */
+        /* takes the block walk */
+        void set_small_triangle_path(bool enabled);
+        bool is_small_triangle_path() const;
+
+        /* rasterization counters since the last reset */
+        RasterStats get_stats() const;
+        void reset_stats();
+
         /* set number of threads for parallel rendering (0 = auto-detect) */
         void set_num_threads(int threads);
 
+        /* enable/disable 4x multisampling for color draws: coverage and depth are tested per */
+        /* sample but the shader runs once per pixel, at its center; enabling copies the */
+        /* framebuffer color and depth into every sample, resolve_msaa averages them back */
+        /* (hierarchical Z and the small-triangle path are not used while it is on) */
+        /* the forward draws, wireframe lines, depth-only draws to the framebuffer and */
+        /* composite_oit write the samples; the visibility, packed and sort-last passes would */
+        /* bypass them and do nothing while it is on */
+        void set_msaa_enabled(bool enabled);
+        bool is_msaa_enabled() const;
+
+        /* reset every sample to its pixel's framebuffer color and depth, sized to the */
+        /* framebuffer; call after clearing the framebuffer each frame while MSAA stays on */
+        /* (set_framebuffer and enabling MSAA do this already) */
+        void clear_msaa();
+
+        /* average the samples into the framebuffer color, nearest sample depth into its depth */
+        void resolve_msaa();
+
+        /* persistent worker pool used by the parallel paths, shareable with other stages */
+        ThreadPool& get_thread_pool();
+
         /* rasterize a single triangle */
         void draw_triangle(const RasterVertex& v0, const RasterVertex& v1, const RasterVertex& v2);
 
-        /* rasterize multiple triangles in parallel */
+        /* rasterize multiple triangles in parallel, each thread owning whole screen tiles */
+        /* triangle order is preserved within every tile, so blending stays correct */
+        /* (in wireframe mode, or with a single thread, triangles are drawn serially, like draw_triangle) */
         void draw_triangles_parallel(const std::vector<RasterVertex>& vertices);
 
+        /* same draws with the shader as a type parameter, inlined into the pixel loop */
+        /* Shader is any callable Color(const Fragment&) safe to call from several threads */
+        template <typename Shader>
+        void draw_triangle(const RasterVertex& v0, const RasterVertex& v1, const RasterVertex& v2, const Shader& shader);
+
+        template <typename Shader>
+        void draw_triangles_parallel(const std::vector<RasterVertex>& vertices, const Shader& shader);
+
+        /* visibility-buffer mode for opaque geometry: */
+        /* begin clears ids, draws store triangle id + depth per pixel, resolve shades each visible pixel once */
+        /* (with ddx/ddy only for draws passing derivatives, which costs two more interpolations per pixel) */
+        void begin_visibility_pass();
+        void draw_triangles_visibility(const std::vector<RasterVertex>& vertices, uint32_t draw_id, bool derivatives = false);
+        void resolve_visibility(const VisibilityShader& shader);
+
+        /* packed mode for unordered opaque geometry, an alternative to tile ownership: */
+        /* begin packs the framebuffer depth, draws split triangles across threads and update each */
+        /* pixel with a compare-and-swap min on its depth+color word, so the nearest fragment wins */
+        /* whatever the order; resolve unpacks covered pixels into the framebuffer */
+        /* colors are stored as RGBA8 and no blending is applied */
+        void begin_packed_pass();
+        template <typename Shader>
+        void draw_triangles_packed(const std::vector<RasterVertex>& vertices, const Shader& shader);
+        void resolve_packed();
+
+        /* weighted blended order-independent transparency: begin clears the accumulation and */
+        /* revealage buffers, draws add depth-tested fragments (no depth writes, no blend mode) */
+        /* in any order on the tiled path, composite blends the weighted average over the framebuffer */
+        /* begin after the opaque draws; multisampled, it first resolves the sample depth into */
+        /* the framebuffer depth the single-sample OIT draws test against */
+        void begin_oit_pass();
+        template <typename Shader>
+        void draw_triangles_oit(const std::vector<RasterVertex>& vertices, const Shader& shader);
+        void composite_oit();
+
+        /* sort-last mode for opaque objects, coexisting with the tiled path: each thread takes */
+        /* whole objects and rasterizes them into its own color + depth copy of the framebuffer */
+        /* with no synchronization, then the copies are depth-composited into the framebuffer */
+        /* Shader is a callable Color(uint32_t draw_id, const Fragment&), draw_id indexes draws; */
+        /* its varyings and derivatives members (see shader_varyings, shader_derivatives) apply */
+        /* to every draw, so declare derivatives if any draw filters textures */
+        /* blend mode must be NONE; depth is always tested before shading, and equal depths go */
+        /* to the lowest draw_id whichever thread drew it, matching forward submission order */
+        template <typename Shader>
+        void draw_objects_sort_last(const std::vector<std::vector<RasterVertex>>& draws, const Shader& shader);
+
+        /* depth-only draws: screen-space positions (3 per triangle, z = depth), tiled and parallel */
+        /* like the color path, but no attributes are interpolated and only depth is written */
+        void draw_depth_only(const std::vector<Vec3>& positions);
+        void draw_depth_only(const std::vector<Vec3>& positions, ShadowMap& shadow_map);
+
         /* draw a line between two points (for wireframe) */
         void draw_line(int x0, int y0, int x1, int y1, Color color);
 };
+
+#include "pipeline/rasterizer_impl.h"
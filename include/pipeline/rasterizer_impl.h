@@ -0,0 +1,756 @@
+#pragma once
+
+/* template definitions for Rasterizer, included at the end of rasterizer.h */
+/* the pixel loop is templated on the shader type so it can be inlined */
+
+#include <algorithm>
+
+inline Fragment Rasterizer::interpolate_fragment(Vec3 bary, const RasterVertex& v0, const RasterVertex& v1, const RasterVertex& v2, Vec3 screen_pos) {
+    Fragment frag;
+
+    /* weight each vertex by 1/w so attributes are interpolated in clip space */
+    Vec3 weights = bary * Vec3(v0.inv_w, v1.inv_w, v2.inv_w);
+    weights /= weights.x + weights.y + weights.z;
+
+    float w0 = weights.x;
+    float w1 = weights.y;
+    float w2 = weights.z;
+
+    frag.screen_pos = screen_pos;
+    frag.world_pos = v0.world_pos * w0 + v1.world_pos * w1 + v2.world_pos * w2;
+    frag.normal = v0.normal * w0 + v1.normal * w1 + v2.normal * w2;
+    frag.tex_coord = v0.tex_coord * w0 + v1.tex_coord * w1 + v2.tex_coord * w2;
+    frag.color = v0.color * w0 + v1.color * w1 + v2.color * w2;
+
+    return frag;
+}
+
+template <uint32_t Set>
+inline Fragment Rasterizer::interpolate_varyings(const TriangleSetup& setup, int x, int y, float depth) const {
+    float v[Varyings::count(Set)];
+    seed_varyings<Set>(setup, x, y, v);
+    return varyings_fragment<Set>(v, x, y, depth);
+}
+
+/* plane loops take their count as a constant: as a call in the loop condition it */
+/* is not folded, and the loops are neither unrolled nor kept in registers */
+template <uint32_t Set>
+inline void Rasterizer::seed_varyings(const TriangleSetup& setup, int x, int y, float* planes) {
+    float fx = static_cast<float>(x - setup.min_x);
+    float fy = static_cast<float>(y - setup.min_y);
+
+    /* attribute/w and 1/w are linear in screen space; only the set's planes exist */
+    constexpr int count = Varyings::count(Set);
+    for (int i = 0; i < count; i++) {
+        planes[i] = setup.varying_origin[i] + setup.varying_dx[i] * fx + setup.varying_dy[i] * fy;
+    }
+}
+
+template <uint32_t Set>
+inline void Rasterizer::step_varyings(const float* step, float* planes) {
+    constexpr int count = Varyings::count(Set);
+    for (int i = 0; i < count; i++) {
+        planes[i] += step[i];
+    }
+}
+
+template <uint32_t Set>
+inline Fragment Rasterizer::varyings_fragment(const float* v, int x, int y, float depth) {
+    /* one reciprocal recovers w for every attribute */
+    float w = 1.0f / v[0];
+
+    Fragment frag;
+    frag.screen_pos = Vec3(x, y, depth);
+    if constexpr ((Set & Varyings::WORLD_POS) != 0) {
+        constexpr int o = Varyings::offset(Set, Varyings::WORLD_POS);
+        frag.world_pos = Vec3(v[o], v[o + 1], v[o + 2]) * w;
+    } else {
+        frag.world_pos = Vec3(0.0f);
+    }
+    if constexpr ((Set & Varyings::NORMAL) != 0) {
+        constexpr int o = Varyings::offset(Set, Varyings::NORMAL);
+        frag.normal = Vec3(v[o], v[o + 1], v[o + 2]) * w;
+    } else {
+        frag.normal = Vec3(0.0f);
+    }
+    if constexpr ((Set & Varyings::TEX_COORD) != 0) {
+        constexpr int o = Varyings::offset(Set, Varyings::TEX_COORD);
+        frag.tex_coord = Vec2(v[o], v[o + 1]) * w;
+    } else {
+        frag.tex_coord = Vec2(0.0f);
+    }
+    if constexpr ((Set & Varyings::COLOR) != 0) {
+        constexpr int o = Varyings::offset(Set, Varyings::COLOR);
+        frag.color = Color(v[o], v[o + 1], v[o + 2], v[o + 3]) * w;
+    } else {
+        frag.color = Color(0.0f);
+    }
+
+    return frag;
+}
+
+inline bool Rasterizer::depth_passes(DepthFunc func, float depth, float stored) {
+    return func == DepthFunc::EQUAL ? depth == stored : depth < stored;
+}
+
+inline bool Rasterizer::depth_occluded(DepthFunc func, float min_depth, float max_depth) {
+    /* an equal test can still pass where the nearest depth meets the stored maximum; the */
+    /* corner estimate may round a few ulps above the per-pixel depths, so allow some slack */
+    if (func == DepthFunc::EQUAL) {
+        return min_depth > max_depth + EQUAL_DEPTH_SLACK;
+    }
+    return min_depth >= max_depth;
+}
+
+inline float Rasterizer::small_triangle_depth(const TriangleSetup& setup, int dx, int dy) {
+    return setup.depth_origin + setup.depth_dx * static_cast<float>(dx) + setup.depth_dy * static_cast<float>(dy);
+}
+
+inline uint32_t Rasterizer::sample_coverage(const TriangleSetup& setup, const RasterBlock& block, int i) {
+    if (block.fully_inside) {
+        return (1u << MSAA_SAMPLES) - 1;
+    }
+    uint32_t coverage = 0;
+    for (int s = 0; s < MSAA_SAMPLES; s++) {
+        bool inside = true;
+        for (int e = 0; e < 3; e++) {
+            inside = inside && block.w_row[e] + setup.edge_dx[e] * i + setup.sample_edge_offset[e][s] >= 0;
+        }
+        coverage |= static_cast<uint32_t>(inside) << s;
+    }
+    return coverage;
+}
+
+inline bool Rasterizer::classify_block(const TriangleSetup& setup, int x0, int y0, int x1, int y1, int64_t* w_row, bool& fully_inside) const {
+    /* edge values at the block's first pixel center; being linear, their */
+    /* extremes over the block are reached at the corners (and their outermost samples) */
+    bool rejected = false;
+    fully_inside = true;
+    for (int e = 0; e < 3; e++) {
+        w_row[e] = setup.edge_origin[e] + setup.edge_dx[e] * (x0 - setup.min_x) + setup.edge_dy[e] * (y0 - setup.min_y);
+        int64_t span_x = setup.edge_dx[e] * (x1 - x0);
+        int64_t span_y = setup.edge_dy[e] * (y1 - y0);
+        rejected = rejected || w_row[e] + std::max<int64_t>(span_x, 0) + std::max<int64_t>(span_y, 0) + setup.sample_max_offset[e] < 0;
+        fully_inside = fully_inside && w_row[e] + std::min<int64_t>(span_x, 0) + std::min<int64_t>(span_y, 0) + setup.sample_min_offset[e] >= 0;
+    }
+    return !rejected;
+}
+
+template <typename BlockAction>
+void Rasterizer::for_each_block(const TriangleSetup& setup, int rect_min_x, int rect_min_y, int rect_max_x, int rect_max_y, FrameBuffer* occlusion, DepthFunc func, FrameBuffer* refresh, RasterStats& counters, const BlockAction& action) const {
+    /* restrict bounding box to the requested rectangle */
+    int min_x = std::max(setup.min_x, rect_min_x);
+    int min_y = std::max(setup.min_y, rect_min_y);
+    int max_x = std::min(setup.max_x, rect_max_x);
+    int max_y = std::min(setup.max_y, rect_max_y);
+    if (min_x > max_x || min_y > max_y) {
+        return;
+    }
+
+    /* walk BLOCK_SIZE x BLOCK_SIZE blocks aligned to the screen grid */
+    int block_min_x = min_x - min_x % BLOCK_SIZE;
+    int block_min_y = min_y - min_y % BLOCK_SIZE;
+
+    for (int by = block_min_y; by <= max_y; by += BLOCK_SIZE) {
+        for (int bx = block_min_x; bx <= max_x; bx += BLOCK_SIZE) {
+            RasterBlock block;
+            block.block_x = bx / BLOCK_SIZE;
+            block.block_y = by / BLOCK_SIZE;
+            block.x0 = std::max(bx, min_x);
+            block.y0 = std::max(by, min_y);
+            block.x1 = std::min(bx + BLOCK_SIZE - 1, max_x);
+            block.y1 = std::min(by + BLOCK_SIZE - 1, max_y);
+
+            /* trivial reject: every pixel is outside the same edge */
+            if (!classify_block(setup, block.x0, block.y0, block.x1, block.y1, block.w_row, block.fully_inside)) {
+                counters.blocks_rejected++;
+                continue;
+            }
+
+            block.depth_row = setup.depth_origin
+                            + setup.depth_dx * static_cast<float>(block.x0 - setup.min_x)
+                            + setup.depth_dy * static_cast<float>(block.y0 - setup.min_y);
+
+            /* hierarchical Z: the nearest depth of the block (a corner, depth is linear) */
+            /* is behind everything stored there, so no pixel can pass the depth test */
+            if (occlusion != nullptr) {
+                float depth_span_x = setup.depth_dx * static_cast<float>(block.x1 - block.x0);
+                float depth_span_y = setup.depth_dy * static_cast<float>(block.y1 - block.y0);
+                float block_min_depth = block.depth_row + std::min(depth_span_x, 0.0f) + std::min(depth_span_y, 0.0f);
+                if (depth_occluded(func, block_min_depth, occlusion->get_block_max_depth(block.block_x, block.block_y))) {
+                    counters.blocks_occluded++;
+                    continue;
+                }
+            }
+
+            /* trivial accept: every pixel is inside all three edges */
+            if (block.fully_inside) {
+                counters.blocks_accepted++;
+            } else {
+                counters.blocks_partial++;
+            }
+
+            /* keep the coarse depth current so later triangles can be rejected */
+            if (action(block) && refresh != nullptr) {
+                refresh->refresh_block_max_depth(block.block_x, block.block_y);
+            }
+        }
+    }
+}
+
+template <typename RowAction>
+void Rasterizer::for_each_depth_block_row(const RowAction& rows) {
+    int height = framebuffer->get_height();
+    int blocks_x = framebuffer->get_blocks_x();
+
+    thread_pool.parallel_for(framebuffer->get_blocks_y(), 1, [&](size_t begin, size_t end, int) {
+        for (int block_y = static_cast<int>(begin); block_y < static_cast<int>(end); block_y++) {
+            int y0 = block_y * BLOCK_SIZE;
+            rows(y0, std::min(y0 + BLOCK_SIZE, height));
+            for (int block_x = 0; block_x < blocks_x; block_x++) {
+                framebuffer->refresh_block_max_depth(block_x, block_y);
+            }
+        }
+    });
+}
+
+template <typename Shader>
+void Rasterizer::rasterize_triangle(const TriangleSetup& setup, FrameBuffer& target, int rect_min_x, int rect_min_y, int rect_max_x, int rect_max_y, RasterStats& counters, const Shader& shader) {
+    if (setup.small) {
+        rasterize_small_triangle(setup, target, rect_min_x, rect_min_y, rect_max_x, rect_max_y, counters, shader);
+        return;
+    }
+    /* multisampling applies to plain color draws into the bound framebuffer */
+    if (msaa_enabled && &target == framebuffer && !visibility_pass && !packed_pass && !oit_pass) {
+        rasterize_triangle_msaa(setup, rect_min_x, rect_min_y, rect_max_x, rect_max_y, counters, shader);
+        return;
+    }
+
+    const float* depth_buffer = target.get_depth_buffer().data();
+    int width = target.get_width();
+
+    /* the packed mode tests depth against its own words, per pixel before shading */
+    bool test_depth = early_depth_test && !packed_pass;
+    bool update_hiz = (depth_write || visibility_pass) && !packed_pass;
+    bool quads = quad_path<Shader>();
+    constexpr uint32_t set = shader_varyings<Shader>::value;
+
+    for_each_block(setup, rect_min_x, rect_min_y, rect_max_x, rect_max_y, test_depth ? &target : nullptr, depth_func,
+                   update_hiz ? &target : nullptr, counters, [&](RasterBlock& block) {
+        int bx = block.block_x * BLOCK_SIZE;
+        int by = block.block_y * BLOCK_SIZE;
+        int x0 = block.x0;
+        int count = block.x1 - x0 + 1;
+        float depth_row = block.depth_row;
+        bool block_written = false;
+
+        /* quad shading collects the block's rows first, relative to its corner */
+        uint32_t row_masks[BLOCK_SIZE] = {};
+        float row_depth[BLOCK_SIZE];
+
+        /* one block row is one span of at most SPAN_WIDTH pixels */
+        for (int y = block.y0; y <= block.y1; y++, depth_row += setup.depth_dy) {
+            const float* span_depth = depth_buffer + y * width + x0;
+
+            /* failing lanes are masked out; accepted blocks only need the depth test */
+            uint32_t mask = span_mask(setup, block.w_row, depth_row, span_depth, count, block.fully_inside, test_depth, depth_func);
+
+            /* only surviving pixels are interpolated and shaded */
+            block_written = block_written || mask != 0;
+            if (quads) {
+                row_masks[y - by] = mask << (x0 - bx);
+                row_depth[y - by] = depth_row;
+            } else {
+                /* the planes are seeded at the row's first pixel and stepped along it */
+                float planes[Varyings::count(set)];
+                seed_varyings<set>(setup, x0, y, planes);
+                for (int i = 0; mask != 0; i++, mask >>= 1, step_varyings<set>(setup.varying_dx, planes)) {
+                    if (mask & 1u) {
+                        shade_pixel(setup, target, x0 + i, y, depth_row + setup.depth_dx * static_cast<float>(i), planes, counters, shader);
+                    }
+                }
+            }
+
+            for (int e = 0; e < 3; e++) {
+                block.w_row[e] += setup.edge_dy[e];
+            }
+        }
+
+        if (quads && block_written) {
+            /* live lanes take the depth the span kernel tested, so equal tests still match */
+            auto depth_at = [&](int x, int y) {
+                if (y >= block.y0 && y <= block.y1) {
+                    return row_depth[y - by] + setup.depth_dx * static_cast<float>(x - x0);
+                }
+                return small_triangle_depth(setup, x - setup.min_x, y - setup.min_y);
+            };
+            shade_quads(setup, target, bx, by, row_masks, BLOCK_SIZE, depth_at, counters, shader);
+        }
+        return block_written;
+    });
+}
+
+template <typename Shader>
+void Rasterizer::rasterize_triangle_msaa(const TriangleSetup& setup, int rect_min_x, int rect_min_y, int rect_max_x, int rect_max_y, RasterStats& counters, const Shader& shader) {
+    constexpr uint32_t set = shader_varyings<Shader>::value;
+
+    /* same block walk as rasterize_triangle; blocks are classified over every sample */
+    /* and depth is tested per sample, so there is no hierarchical Z to use or keep */
+    for_each_block(setup, rect_min_x, rect_min_y, rect_max_x, rect_max_y, nullptr, depth_func, nullptr, counters, [&](RasterBlock& block) {
+        float depth_row = block.depth_row;
+        for (int y = block.y0; y <= block.y1; y++, depth_row += setup.depth_dy) {
+            float planes[Varyings::count(set)];
+            seed_varyings<set>(setup, block.x0, y, planes);
+            for (int i = 0; i <= block.x1 - block.x0; i++, step_varyings<set>(setup.varying_dx, planes)) {
+                uint32_t coverage = sample_coverage(setup, block, i);
+                if (coverage != 0) {
+                    shade_samples(setup, block.x0 + i, y, depth_row + setup.depth_dx * static_cast<float>(i), planes, coverage, counters, shader);
+                }
+            }
+
+            for (int e = 0; e < 3; e++) {
+                block.w_row[e] += setup.edge_dy[e];
+            }
+        }
+        return false;
+    });
+}
+
+template <typename Shader>
+void Rasterizer::shade_samples(const TriangleSetup& setup, int x, int y, float depth, const float* planes, uint32_t coverage, RasterStats& counters, const Shader& shader) {
+    size_t first = (static_cast<size_t>(y) * framebuffer->get_width() + x) * MSAA_SAMPLES;
+    Color* colors = &sample_color[first];
+    float* depths = &sample_depth[first];
+
+    /* depth is tested per sample, at the sample position */
+    float sample_z[MSAA_SAMPLES];
+    for (int s = 0; s < MSAA_SAMPLES; s++) {
+        sample_z[s] = depth + setup.sample_depth_offset[s];
+        if (early_depth_test && (coverage >> s & 1u) && !depth_passes(depth_func, sample_z[s], depths[s])) {
+            coverage &= ~(1u << s);
+        }
+    }
+    if (coverage == 0) {
+        return;
+    }
+
+    /* one shader invocation at the pixel center serves every covered sample */
+    Color color = shader(varyings_fragment<shader_varyings<Shader>::value>(planes, x, y, depth));
+    counters.fragments_shaded++;
+
+    bool written = false;
+    for (int s = 0; s < MSAA_SAMPLES; s++) {
+        if (!(coverage >> s & 1u)) continue;
+        if (!early_depth_test && !depth_passes(depth_func, sample_z[s], depths[s])) continue;
+
+        colors[s] = blend_mode == BlendMode::NONE ? color : FrameBuffer::blend(color, colors[s], blend_mode);
+        if (depth_write) {
+            depths[s] = sample_z[s];
+        }
+        written = true;
+    }
+    if (written) {
+        counters.fragments_written++;
+    }
+}
+
+template <typename Shader>
+void Rasterizer::rasterize_small_triangle(const TriangleSetup& setup, FrameBuffer& target, int rect_min_x, int rect_min_y, int rect_max_x, int rect_max_y, RasterStats& counters, const Shader& shader) {
+    const float* depth_buffer = target.get_depth_buffer().data();
+    int width = target.get_width();
+    bool written = false;
+    bool quads = quad_path<Shader>();
+
+    /* quads are aligned to even pixels, so an odd footprint spans one more row and column */
+    int origin_x = setup.min_x & ~1;
+    int origin_y = setup.min_y & ~1;
+    uint32_t row_masks[SMALL_TRIANGLE_SIZE + 2] = {};
+
+    /* coverage came from setup, walk its set bits */
+    uint32_t mask = setup.small_coverage;
+    for (int i = 0; mask != 0; i++, mask >>= 1) {
+        if (!(mask & 1u)) continue;
+
+        int dx = i % SMALL_TRIANGLE_SIZE;
+        int dy = i / SMALL_TRIANGLE_SIZE;
+        int x = setup.min_x + dx;
+        int y = setup.min_y + dy;
+
+        /* the footprint may straddle a tile border */
+        if (x < rect_min_x || x > rect_max_x || y < rect_min_y || y > rect_max_y) continue;
+
+        float depth = small_triangle_depth(setup, dx, dy);
+        if (early_depth_test && !packed_pass && !depth_passes(depth_func, depth, depth_buffer[y * width + x])) continue;
+
+        if (quads) {
+            row_masks[y - origin_y] |= 1u << (x - origin_x);
+        } else {
+            float planes[Varyings::count(shader_varyings<Shader>::value)];
+            seed_varyings<shader_varyings<Shader>::value>(setup, x, y, planes);
+            shade_pixel(setup, target, x, y, depth, planes, counters, shader);
+        }
+        written = true;
+    }
+
+    if (quads && written) {
+        auto depth_at = [&](int x, int y) {
+            return small_triangle_depth(setup, x - setup.min_x, y - setup.min_y);
+        };
+        shade_quads(setup, target, origin_x, origin_y, row_masks, SMALL_TRIANGLE_SIZE + 2, depth_at, counters, shader);
+    }
+
+    /* keep the coarse depth current, the footprint touches at most 2x2 blocks */
+    if (written && (depth_write || visibility_pass) && !packed_pass) {
+        int block_min_x = std::max(setup.min_x, rect_min_x) / BLOCK_SIZE;
+        int block_min_y = std::max(setup.min_y, rect_min_y) / BLOCK_SIZE;
+        int block_max_x = std::min(setup.max_x, rect_max_x) / BLOCK_SIZE;
+        int block_max_y = std::min(setup.max_y, rect_max_y) / BLOCK_SIZE;
+        for (int by = block_min_y; by <= block_max_y; by++) {
+            for (int bx = block_min_x; bx <= block_max_x; bx++) {
+                target.refresh_block_max_depth(bx, by);
+            }
+        }
+    }
+}
+
+template <typename Shader>
+void Rasterizer::shade_packed_pixel(int x, int y, float depth, const float* planes, RasterStats& counters, const Shader& shader) {
+    std::atomic<uint64_t>& word = packed_buffer[y * framebuffer->get_width() + x];
+    uint64_t depth_bits = static_cast<uint64_t>(pack_depth(depth)) << 32;
+
+    /* stored words only ever decrease, so a nearer depth already there means this */
+    /* fragment cannot win; equal depths still shade since the color breaks the tie */
+    uint64_t current = word.load(std::memory_order_relaxed);
+    if (depth_bits > (current & 0xFFFFFFFF00000000ull)) {
+        return;
+    }
+
+    Fragment frag = varyings_fragment<shader_varyings<Shader>::value>(planes, x, y, depth);
+    uint64_t packed = depth_bits | pack_color(shader(frag));
+    counters.fragments_shaded++;
+
+    /* atomic min: retry until this word is stored or a smaller one is found */
+    while (packed < current) {
+        if (word.compare_exchange_weak(current, packed, std::memory_order_relaxed)) {
+            counters.fragments_written++;
+            return;
+        }
+    }
+}
+
+/* inline: called per pixel from the span loop, whose stepped planes would otherwise */
+/* be spilled and reloaded around every call */
+template <typename Shader>
+inline void Rasterizer::shade_pixel(const TriangleSetup& setup, FrameBuffer& target, int x, int y, float depth, const float* planes, RasterStats& counters, const Shader& shader) {
+    if (packed_pass) {
+        shade_packed_pixel(x, y, depth, planes, counters, shader);
+        return;
+    }
+
+    /* visibility pass: only record which triangle is visible, shading is deferred */
+    if (visibility_pass) {
+        if (!early_depth_test && !depth_passes(depth_func, depth, target.get_depth(x, y))) {
+            return;
+        }
+        visibility_buffer[y * target.get_width() + x] = setup.triangle_id;
+        target.set_depth(x, y, depth);
+        counters.fragments_written++;
+        return;
+    }
+
+    /* create fragment with perspective-correct attributes */
+    Fragment frag = varyings_fragment<shader_varyings<Shader>::value>(planes, x, y, depth);
+
+    /* compute final color */
+    Color color = shader(frag);
+    counters.fragments_shaded++;
+
+    write_fragment(target, x, y, depth, color, counters);
+}
+
+inline void Rasterizer::write_fragment(FrameBuffer& target, int x, int y, float depth, Color color, RasterStats& counters) {
+    /* late depth test: the shaded result may still be occluded */
+    if (!early_depth_test && !depth_passes(depth_func, depth, target.get_depth(x, y))) {
+        return;
+    }
+    counters.fragments_written++;
+
+    /* transparent fragments only accumulate, the composite pass resolves them */
+    if (oit_pass) {
+        accumulate_oit(x, y, color, depth);
+        return;
+    }
+
+    /* write to framebuffer with blending */
+    if (blend_mode == BlendMode::NONE) {
+        target.set_pixel(x, y, color);
+    } else {
+        target.set_pixel_blended(x, y, color, blend_mode);
+    }
+
+    /* update depth buffer if depth writing is enabled */
+    if (depth_write) {
+        target.set_depth(x, y, depth);
+    }
+}
+
+template <uint32_t Set>
+inline FragmentDerivatives Rasterizer::attribute_delta(const Fragment& from, const Fragment& to) {
+    FragmentDerivatives delta;
+    if constexpr ((Set & Varyings::WORLD_POS) != 0) {
+        delta.world_pos = to.world_pos - from.world_pos;
+    }
+    if constexpr ((Set & Varyings::NORMAL) != 0) {
+        delta.normal = to.normal - from.normal;
+    }
+    if constexpr ((Set & Varyings::TEX_COORD) != 0) {
+        delta.tex_coord = to.tex_coord - from.tex_coord;
+    }
+    if constexpr ((Set & Varyings::COLOR) != 0) {
+        delta.color = to.color - from.color;
+    }
+    return delta;
+}
+
+template <typename Shader>
+bool Rasterizer::quad_path() const {
+    return shader_derivatives<Shader>::value && quad_shading && !visibility_pass && !packed_pass;
+}
+
+template <typename Shader, typename DepthAt>
+void Rasterizer::shade_quads(const TriangleSetup& setup, FrameBuffer& target, int origin_x, int origin_y, const uint32_t* row_masks, int rows, const DepthAt& depth_at, RasterStats& counters, const Shader& shader) {
+    for (int r = 0; r + 1 < rows; r += 2) {
+        uint32_t top = row_masks[r];
+        uint32_t bottom = row_masks[r + 1];
+
+        /* a quad with no live pixel costs one mask test, the walk ends with the last one */
+        for (int q = 0; (top | bottom) != 0; q++, top >>= 2, bottom >>= 2) {
+            uint32_t mask = (top & 3u) | (bottom & 3u) << 2;
+            if (mask != 0) {
+                shade_quad(setup, target, origin_x + 2 * q, origin_y + r, mask, depth_at, counters, shader);
+            }
+        }
+    }
+}
+
+template <typename Shader, typename DepthAt>
+void Rasterizer::shade_quad(const TriangleSetup& setup, FrameBuffer& target, int x, int y, uint32_t mask, const DepthAt& depth_at, RasterStats& counters, const Shader& shader) {
+    constexpr uint32_t set = shader_varyings<Shader>::value;
+    FragmentQuad quad;
+    quad.mask = mask;
+
+    /* helper lanes come from the same planes, outside the triangle if need be; the */
+    /* first lane is seeded, the others are one step right and/or down from it */
+    constexpr int count = Varyings::count(set);
+    float planes[4][count];
+    seed_varyings<set>(setup, x, y, planes[0]);
+    for (int i = 0; i < count; i++) {
+        planes[1][i] = planes[0][i] + setup.varying_dx[i];
+        planes[2][i] = planes[0][i] + setup.varying_dy[i];
+        planes[3][i] = planes[1][i] + setup.varying_dy[i];
+    }
+    for (int lane = 0; lane < 4; lane++) {
+        int lane_x = x + (lane & 1);
+        int lane_y = y + (lane >> 1);
+        quad.fragments[lane] = varyings_fragment<set>(planes[lane], lane_x, lane_y, depth_at(lane_x, lane_y));
+    }
+
+    /* coarse derivatives: the top row and left column serve the whole quad */
+    FragmentDerivatives ddx = attribute_delta<set>(quad.fragments[0], quad.fragments[1]);
+    FragmentDerivatives ddy = attribute_delta<set>(quad.fragments[0], quad.fragments[2]);
+    for (Fragment& frag : quad.fragments) {
+        frag.ddx = ddx;
+        frag.ddy = ddy;
+    }
+
+    Color colors[4];
+    if constexpr (is_quad_shader<Shader>) {
+        shader(quad, colors);
+    } else {
+        for (int lane = 0; lane < 4; lane++) {
+            if (mask >> lane & 1u) {
+                colors[lane] = shader(quad.fragments[lane]);
+            }
+        }
+    }
+
+    for (int lane = 0; lane < 4; lane++) {
+        if (mask >> lane & 1u) {
+            counters.fragments_shaded++;
+            write_fragment(target, x + (lane & 1), y + (lane >> 1), quad.fragments[lane].screen_pos.z, colors[lane], counters);
+        }
+    }
+}
+
+template <typename Shader>
+void Rasterizer::rasterize_tiles(const Shader& shader) {
+    build_tile_tasks();
+
+    /* counters are kept per thread and merged after the job */
+    std::vector<RasterStats> thread_stats(thread_pool.get_num_threads());
+
+    /* tasks never share pixels, so threads need no synchronization */
+    thread_pool.parallel_for(tile_tasks.size(), 1, [&](size_t begin, size_t end, int thread_id) {
+        for (size_t t = begin; t < end; t++) {
+            const TileTask& task = tile_tasks[t];
+            for (uint32_t setup_index : tile_bins[task.tile]) {
+                rasterize_triangle(triangle_setups[setup_index], *framebuffer, task.min_x, task.min_y, task.max_x, task.max_y, thread_stats[thread_id], shader);
+            }
+        }
+    });
+
+    for (const RasterStats& counters : thread_stats) {
+        stats.merge(counters);
+    }
+}
+
+template <typename Shader>
+void Rasterizer::draw_triangle(const RasterVertex& v0, const RasterVertex& v1, const RasterVertex& v2, const Shader& shader) {
+    if (framebuffer == nullptr) {
+        return;
+    }
+
+    TriangleSetup setup;
+    if (!setup_triangle(v0, v1, v2, shader_varyings<Shader>::value, setup)) {
+        return;
+    }
+    setup.triangle_id = 0;
+
+    /* wireframe mode: just draw edges */
+    if (wireframe_mode) {
+        draw_line(static_cast<int>(v0.position.x), static_cast<int>(v0.position.y),
+                  static_cast<int>(v1.position.x), static_cast<int>(v1.position.y), v0.color);
+        draw_line(static_cast<int>(v1.position.x), static_cast<int>(v1.position.y),
+                  static_cast<int>(v2.position.x), static_cast<int>(v2.position.y), v1.color);
+        draw_line(static_cast<int>(v2.position.x), static_cast<int>(v2.position.y),
+                  static_cast<int>(v0.position.x), static_cast<int>(v0.position.y), v2.color);
+        return;
+    }
+
+    rasterize_triangle(setup, *framebuffer, 0, 0, framebuffer->get_width() - 1, framebuffer->get_height() - 1, stats, shader);
+}
+
+template <typename Shader>
+void Rasterizer::draw_triangles_parallel(const std::vector<RasterVertex>& vertices, const Shader& shader) {
+    if (framebuffer == nullptr || vertices.size() < 3) {
+        return;
+    }
+
+    /* wireframe mode: lines are not binned, each triangle is culled and outlined; a single */
+    /* thread gains nothing from owning tiles, so it skips binning and draws the triangles */
+    /* in submission order over the whole screen */
+    if (wireframe_mode || thread_pool.get_num_threads() == 1) {
+        for (size_t i = 0; i + 2 < vertices.size(); i += 3) {
+            draw_triangle(vertices[i], vertices[i + 1], vertices[i + 2], shader);
+        }
+        return;
+    }
+
+    /* binning pass: triangles are set up once and listed per tile */
+    bin_triangles(vertices.data(), vertices.size() / 3, 0, shader_varyings<Shader>::value);
+    rasterize_tiles(shader);
+}
+
+template <typename Shader>
+void Rasterizer::draw_triangles_packed(const std::vector<RasterVertex>& vertices, const Shader& shader) {
+    if (framebuffer == nullptr || msaa_enabled || !packed_buffer || vertices.size() < 3) {
+        return;
+    }
+
+    int max_x = framebuffer->get_width() - 1;
+    int max_y = framebuffer->get_height() - 1;
+    size_t num_triangles = vertices.size() / 3;
+    std::vector<RasterStats> thread_stats(thread_pool.get_num_threads());
+
+    /* no binning: threads take batches of triangles and may touch any pixel, */
+    /* the packed words resolve the overlap */
+    packed_pass = true;
+    thread_pool.parallel_for(num_triangles, PACKED_BATCH, [&](size_t begin, size_t end, int thread_id) {
+        for (size_t i = begin; i < end; i++) {
+            TriangleSetup setup;
+            if (!setup_triangle(vertices[i * 3], vertices[i * 3 + 1], vertices[i * 3 + 2], shader_varyings<Shader>::value, setup)) {
+                continue;
+            }
+            if (setup.small && setup.small_coverage == 0) {
+                continue;
+            }
+            rasterize_triangle(setup, *framebuffer, 0, 0, max_x, max_y, thread_stats[thread_id], shader);
+        }
+    });
+    packed_pass = false;
+
+    for (const RasterStats& counters : thread_stats) {
+        stats.merge(counters);
+    }
+}
+
+template <typename Shader>
+void Rasterizer::draw_triangles_oit(const std::vector<RasterVertex>& vertices, const Shader& shader) {
+    if (oit_accumulation.empty()) {
+        return;
+    }
+
+    /* accumulation commutes, so the tiled path needs no ordering beyond its own */
+    oit_pass = true;
+    draw_triangles_parallel(vertices, shader);
+    oit_pass = false;
+}
+
+template <typename Shader>
+void Rasterizer::draw_objects_sort_last(const std::vector<std::vector<RasterVertex>>& draws, const Shader& shader) {
+    if (framebuffer == nullptr || msaa_enabled || draws.empty()) {
+        return;
+    }
+
+    begin_sort_last();
+    int max_x = framebuffer->get_width() - 1;
+    int max_y = framebuffer->get_height() - 1;
+    std::vector<RasterStats> thread_stats(thread_pool.get_num_threads());
+
+    /* a shaded fragment must be a written one for the draw ids below to be exact */
+    bool saved_early_depth_test = early_depth_test;
+    early_depth_test = true;
+
+    /* objects are the tasks, claimed in increasing order so a target keeps the lower */
+    /* draw_id on equal depth; a thread owns every pixel of its target */
+    std::atomic<size_t> next_draw(0);
+    thread_pool.parallel_for(thread_pool.get_num_threads(), 1, [&](size_t, size_t, int thread_id) {
+        FrameBuffer& target = *thread_targets[thread_id];
+        std::vector<uint32_t>& draw_ids = thread_draw_ids[thread_id];
+        int width = target.get_width();
+
+        /* start from the shared depth so occluded work is still culled */
+        if (!thread_target_used[thread_id]) {
+            target.copy_depth(*framebuffer);
+            std::fill(draw_ids.begin(), draw_ids.end(), SORT_LAST_EMPTY);
+            thread_target_used[thread_id] = 1;
+        }
+
+        for (size_t d = next_draw++; d < draws.size(); d = next_draw++) {
+            const std::vector<RasterVertex>& vertices = draws[d];
+            uint32_t draw_id = static_cast<uint32_t>(d);
+            auto draw_shader = with_varyings<shader_varyings<Shader>::value, shader_derivatives<Shader>::value>([&](const Fragment& frag) {
+                draw_ids[static_cast<int>(frag.screen_pos.y) * width + static_cast<int>(frag.screen_pos.x)] = draw_id;
+                return shader(draw_id, frag);
+            });
+
+            for (size_t i = 0; i + 2 < vertices.size(); i += 3) {
+                TriangleSetup setup;
+                if (!setup_triangle(vertices[i], vertices[i + 1], vertices[i + 2], shader_varyings<Shader>::value, setup)) {
+                    continue;
+                }
+                if (setup.small && setup.small_coverage == 0) {
+                    continue;
+                }
+                rasterize_triangle(setup, target, 0, 0, max_x, max_y, thread_stats[thread_id], draw_shader);
+            }
+        }
+    });
+    early_depth_test = saved_early_depth_test;
+
+    for (const RasterStats& counters : thread_stats) {
+        stats.merge(counters);
+    }
+
+    composite_sort_last();
+}
@@ -45,6 +45,9 @@ class ShadowMap {
         /* sample shadow with PCF (percentage closer filtering) */
         float sample_shadow_pcf(Vec3 world_pos, int kernel_size = 3) const;
 
+        /* raw depth access for the rasterizer's depth-only path */
+        std::vector<float>& get_depth_buffer();
+
         /* getters */
         int get_width() const;
         int get_height() const;
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+/* varying attribute sets: which interpolated attributes a shader reads */
+/* undeclared attributes are not clipped, set up or interpolated and read as zero */
+/* ClipVertex, RasterVertex and Fragment still store every attribute: a set trims work, not layout */
+namespace Varyings {
+    constexpr uint32_t NONE      = 0;
+    constexpr uint32_t WORLD_POS = 1u << 0;
+    constexpr uint32_t NORMAL    = 1u << 1;
+    constexpr uint32_t TEX_COORD = 1u << 2;
+    constexpr uint32_t COLOR     = 1u << 3;
+    constexpr uint32_t ALL       = WORLD_POS | NORMAL | TEX_COORD | COLOR;
+
+    /* floats in the packed plane layout of a set: 1/w, then the declared attributes in bit order */
+    constexpr int count(uint32_t set) {
+        return 1 + ((set & WORLD_POS) ? 3 : 0) + ((set & NORMAL) ? 3 : 0)
+                 + ((set & TEX_COORD) ? 2 : 0) + ((set & COLOR) ? 4 : 0);
+    }
+
+    /* first float of an attribute in the packed layout of a set */
+    constexpr int offset(uint32_t set, uint32_t attribute) {
+        return count(set & (attribute - 1));
+    }
+}
+
+/* a shader type declares its set with a static constexpr uint32_t varyings member, */
+/* shaders without one read every attribute */
+template <typename Shader, typename = void>
+struct shader_varyings {
+    static constexpr uint32_t value = Varyings::ALL;
+};
+
+template <typename Shader>
+struct shader_varyings<Shader, std::void_t<decltype(Shader::varyings)>> {
+    static constexpr uint32_t value = Shader::varyings;
+};
@@ -3,6 +3,8 @@
 #include "math/vector.h"
 #include "math/matrix.h"
 #include "camera.h"
+#include "pipeline/clipper.h"
+#include <cstddef>
 
 /* input vertex from mesh */
 struct VertexInput {
@@ -37,6 +39,7 @@ class VertexProcessor {
         Uniforms uniforms;
         int viewport_width;
         int viewport_height;
+        bool simd_enabled;
 
         /* update derived matrices (MVP, normal matrix) */
         void update_matrices();
@@ -62,6 +65,16 @@ class VertexProcessor {
         /* process a single vertex */
         VertexOutput process_vertex(const VertexInput& input);
 
+        /* process a batch of vertices straight into clipper vertices: positions and normals */
+        /* are staged as structure of arrays and transformed BATCH_SIZE at a time (AVX2 if */
+        /* available); unlike process_vertex no NDC or screen position is computed */
+        static constexpr int BATCH_SIZE = 8;
+        void process_vertices(const VertexInput* inputs, size_t count, ClipVertex* outputs);
+
+        /* enable/disable the AVX2 batch kernel (stays off if the CPU lacks AVX2) */
+        void set_simd_enabled(bool enabled);
+        bool is_simd_enabled() const;
+
         /* get current uniforms */
         Uniforms get_uniforms();
 };
@@ -17,6 +17,13 @@ enum class WrapMode {
     MIRRORED_REPEAT /* tile with mirroring */
 };
 
+/* one reduced level of a mip chain */
+struct MipLevel {
+    int width;
+    int height;
+    std::vector<Color> pixels;
+};
+
 class Texture {
     private:
         std::vector<Color> pixels;
@@ -25,12 +32,13 @@ class Texture {
         int channels;
         FilterMode filter_mode;
         WrapMode wrap_mode;
+        std::vector<MipLevel> mips;     /* levels 1.. (level 0 is pixels), empty until generated */
 
         /* wrap UV coordinate based on wrap mode */
         float wrap_coord(float coord) const;
 
-        /* get pixel at integer coordinates (with bounds checking) */
-        Color get_pixel(int x, int y) const;
+        /* filtered lookup of wrapped, flipped coordinates in one level's pixels */
+        Color sample_level(const Color* level_pixels, int level_width, int level_height, float u, float v) const;
 
     public:
         /* constructor */
@@ -52,6 +60,15 @@ class Texture {
         Color sample(Vec2 uv) const;
         Color sample(float u, float v) const;
 
+        /* sample with the UV change per pixel in x and y (Fragment::ddx/ddy): the level */
+        /* follows the larger texel footprint, blending two levels when BILINEAR */
+        /* falls back to the full-size texture without mipmaps or with zero derivatives */
+        Color sample(Vec2 uv, Vec2 duv_dx, Vec2 duv_dy) const;
+
+        /* build the mip chain by 2x2 box filtering down to 1x1 (dropped on reload) */
+        void generate_mipmaps();
+        int get_mip_levels() const;
+
         /* setters */
         void set_filter_mode(FilterMode mode);
         void set_wrap_mode(WrapMode mode);
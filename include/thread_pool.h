@@ -0,0 +1,94 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <cstddef>
+
+/* per-thread load balance counters, accumulated over jobs */
+struct ThreadStats {
+    double busy_seconds;     /* time spent running job chunks */
+    double idle_seconds;     /* job time spent waking up, stealing or waiting */
+    size_t tasks_run;
+    size_t tasks_stolen;
+
+    ThreadStats() : busy_seconds(0.0), idle_seconds(0.0), tasks_run(0), tasks_stolen(0) {}
+};
+
+/* long-lived worker threads shared by the pipeline stages */
+/* the calling thread takes part in every job as thread 0, workers are 1..n-1 */
+/* each job is split into one contiguous range per thread; a thread that runs dry */
+/* steals the back half of another thread's remaining range */
+class ThreadPool {
+    private:
+        /* remaining task range of one thread, front is popped by the owner, back is stolen */
+        struct alignas(64) WorkQueue {
+            std::mutex lock;
+            size_t begin;
+            size_t end;
+        };
+
+        /* per-thread counters, padded so threads do not share cache lines */
+        struct alignas(64) PaddedStats {
+            ThreadStats stats;
+        };
+
+        std::vector<std::thread> workers;
+        int num_threads;
+        std::unique_ptr<WorkQueue[]> queues;
+        std::unique_ptr<PaddedStats[]> thread_stats;
+        double job_seconds;
+
+        /* current job, published under job_mutex */
+        std::mutex job_mutex;
+        std::condition_variable job_ready;
+        std::condition_variable job_done;
+        const std::function<void(size_t, size_t, int)>* job_body;
+        size_t job_count;
+        size_t job_grain;
+        int workers_busy;
+        unsigned long job_generation;
+        bool stopping;
+
+        /* worker thread main loop, seen_generation is the last job it must not join */
+        void worker_loop(int thread_id, unsigned long seen_generation);
+
+        /* run chunks from the own queue, then from other threads' queues, until none are left */
+        void run_chunks(int thread_id);
+
+        /* take the next chunk from the front of the own queue */
+        bool pop_chunk(int thread_id, size_t& begin, size_t& end);
+
+        /* move the back half of another thread's queue into the own queue */
+        bool steal_chunks(int thread_id);
+
+        /* start/stop worker threads */
+        void start(int threads);
+        void stop();
+
+    public:
+        /* constructor (0 = hardware concurrency) */
+        ThreadPool(int threads = 0);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        /* change the number of threads (including the caller), 0 = hardware concurrency */
+        void resize(int threads);
+
+        /* number of threads taking part in a job, including the caller */
+        int get_num_threads() const;
+
+        /* run body(begin, end, thread_id) over [0, count) in chunks of grain items and wait */
+        /* thread_id is in [0, get_num_threads()); calls from inside a job run serially */
+        /* and keep the thread_id of the pool thread making the call */
+        void parallel_for(size_t count, size_t grain, const std::function<void(size_t begin, size_t end, int thread_id)>& body);
+
+        /* busy/idle report per thread since the last reset */
+        std::vector<ThreadStats> get_thread_stats() const;
+        void reset_thread_stats();
+};
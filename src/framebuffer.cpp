@@ -6,6 +6,9 @@ FrameBuffer::FrameBuffer(int i_width, int i_height) {
     height = i_height;
     color_buffer.resize(width * height);
     depth_buffer.resize(width * height);
+    blocks_x = (width + DEPTH_BLOCK_SIZE - 1) / DEPTH_BLOCK_SIZE;
+    blocks_y = (height + DEPTH_BLOCK_SIZE - 1) / DEPTH_BLOCK_SIZE;
+    block_max_depth.resize(blocks_x * blocks_y);
     clear(Colors::black());
     clear_depth(1.0f);
 }
@@ -20,6 +23,9 @@ void FrameBuffer::clear_depth(float value) {
     for (int i = 0; i < width * height; i++) {
         depth_buffer[i] = value;
     }
+    for (int i = 0; i < blocks_x * blocks_y; i++) {
+        block_max_depth[i] = value;
+    }
 }
 
 void FrameBuffer::set_pixel(int x, int y, Color color) {
@@ -35,48 +41,48 @@ void FrameBuffer::set_pixel_blended(int x, int y, Color color, BlendMode mode) {
         return;
     }
     int index = y * width + x;
+    color_buffer[index] = blend(color, color_buffer[index], mode);
+}
 
-    if (mode == BlendMode::NONE) {
-        color_buffer[index] = color;
-        return;
-    }
-
-    Color dst = color_buffer[index];
+Color FrameBuffer::blend(Color src, Color dst, BlendMode mode) {
     Color result;
 
     switch (mode) {
+        case BlendMode::NONE:
+            result = src;
+            break;
         case BlendMode::ALPHA: {
             /* standard alpha blending: src * alpha + dst * (1 - alpha) */
-            float alpha = color.a;
+            float alpha = src.a;
             float inv_alpha = 1.0f - alpha;
-            result.r = color.r * alpha + dst.r * inv_alpha;
-            result.g = color.g * alpha + dst.g * inv_alpha;
-            result.b = color.b * alpha + dst.b * inv_alpha;
+            result.r = src.r * alpha + dst.r * inv_alpha;
+            result.g = src.g * alpha + dst.g * inv_alpha;
+            result.b = src.b * alpha + dst.b * inv_alpha;
             result.a = alpha + dst.a * inv_alpha;
             break;
         }
         case BlendMode::ADDITIVE: {
             /* additive blending: src + dst */
-            result.r = std::min(color.r + dst.r, 1.0f);
-            result.g = std::min(color.g + dst.g, 1.0f);
-            result.b = std::min(color.b + dst.b, 1.0f);
-            result.a = std::min(color.a + dst.a, 1.0f);
+            result.r = std::min(src.r + dst.r, 1.0f);
+            result.g = std::min(src.g + dst.g, 1.0f);
+            result.b = std::min(src.b + dst.b, 1.0f);
+            result.a = std::min(src.a + dst.a, 1.0f);
             break;
         }
         case BlendMode::MULTIPLY: {
             /* multiply blending: src * dst */
-            result.r = color.r * dst.r;
-            result.g = color.g * dst.g;
-            result.b = color.b * dst.b;
-            result.a = color.a * dst.a;
+            result.r = src.r * dst.r;
+            result.g = src.g * dst.g;
+            result.b = src.b * dst.b;
+            result.a = src.a * dst.a;
             break;
         }
         default:
-            result = color;
+            result = src;
             break;
     }
 
-    color_buffer[index] = result;
+    return result;
 }
 
 Color FrameBuffer::get_pixel(int x, int y) {
@@ -93,6 +99,10 @@ void FrameBuffer::set_depth(int x, int y, float depth) {
     }
     int index = y * width + x;
     depth_buffer[index] = depth;
+
+    /* a farther write can raise the block max, a closer one keeps it conservative */
+    float& block_max = block_max_depth[(y / DEPTH_BLOCK_SIZE) * blocks_x + x / DEPTH_BLOCK_SIZE];
+    block_max = std::max(block_max, depth);
 }
 
 float FrameBuffer::get_depth(int x, int y) {
@@ -115,6 +125,62 @@ bool FrameBuffer::depth_test(int x, int y, float new_depth) {
     return false;
 }
 
+float FrameBuffer::get_block_max_depth(int bx, int by) {
+    if (bx < 0 || bx >= blocks_x || by < 0 || by >= blocks_y) {
+        return 1.0f;
+    }
+    return block_max_depth[by * blocks_x + bx];
+}
+
+void FrameBuffer::refresh_block_max_depth(int bx, int by) {
+    if (bx < 0 || bx >= blocks_x || by < 0 || by >= blocks_y) {
+        return;
+    }
+
+    int x0 = bx * DEPTH_BLOCK_SIZE;
+    int y0 = by * DEPTH_BLOCK_SIZE;
+    int x1 = std::min(x0 + DEPTH_BLOCK_SIZE, width);
+    int y1 = std::min(y0 + DEPTH_BLOCK_SIZE, height);
+
+    /* interior blocks: per-column maxima vectorize, one horizontal pass at the end */
+    if (x1 - x0 == DEPTH_BLOCK_SIZE && y1 - y0 == DEPTH_BLOCK_SIZE) {
+        const float* row = &depth_buffer[y0 * width + x0];
+        float column_max[DEPTH_BLOCK_SIZE];
+        for (int x = 0; x < DEPTH_BLOCK_SIZE; x++) {
+            column_max[x] = row[x];
+        }
+        for (int y = 1; y < DEPTH_BLOCK_SIZE; y++) {
+            row += width;
+            for (int x = 0; x < DEPTH_BLOCK_SIZE; x++) {
+                column_max[x] = std::max(column_max[x], row[x]);
+            }
+        }
+
+        float max_depth = column_max[0];
+        for (int x = 1; x < DEPTH_BLOCK_SIZE; x++) {
+            max_depth = std::max(max_depth, column_max[x]);
+        }
+        block_max_depth[by * blocks_x + bx] = max_depth;
+        return;
+    }
+
+    float max_depth = depth_buffer[y0 * width + x0];
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+            max_depth = std::max(max_depth, depth_buffer[y * width + x]);
+        }
+    }
+    block_max_depth[by * blocks_x + bx] = max_depth;
+}
+
+void FrameBuffer::copy_depth(const FrameBuffer& source) {
+    if (source.width != width || source.height != height) {
+        return;
+    }
+    depth_buffer = source.depth_buffer;
+    block_max_depth = source.block_max_depth;
+}
+
 int FrameBuffer::get_width() {
     return width;
 }
@@ -130,3 +196,11 @@ std::vector<Color>& FrameBuffer::get_color_buffer() {
 std::vector<float>& FrameBuffer::get_depth_buffer() {
     return depth_buffer;
 }
+
+int FrameBuffer::get_blocks_x() {
+    return blocks_x;
+}
+
+int FrameBuffer::get_blocks_y() {
+    return blocks_y;
+}
@@ -7,84 +7,57 @@
 #include "pipeline/rasterizer.h"
 #include "pipeline/vertex_processor.h"
 #include "pipeline/clipper.h"
+#include "pipeline/primitive_assembler.h"
 #include "pipeline/fragment_processor.h"
 #include "pipeline/shadow_map.h"
 #include <iostream>
 
-/* helper to convert VertexOutput to ClipVertex */
-ClipVertex to_clip_vertex(const VertexOutput& v) {
-    ClipVertex cv;
-    cv.clip_pos = v.clip_pos;
-    cv.world_pos = v.world_pos;
-    cv.normal = v.normal;
-    cv.tex_coord = v.tex_coord;
-    cv.color = v.color;
-    return cv;
-}
-
-/* helper to convert ClipVertex to RasterVertex (with perspective divide) */
-RasterVertex to_raster_vertex(const ClipVertex& cv, int viewport_width, int viewport_height) {
-    RasterVertex rv;
-
-    /* perspective divide */
-    Vec3 ndc;
-    if (cv.clip_pos.w != 0) {
-        ndc = Vec3(
-            cv.clip_pos.x / cv.clip_pos.w,
-            cv.clip_pos.y / cv.clip_pos.w,
-            cv.clip_pos.z / cv.clip_pos.w
-        );
-    } else {
-        ndc = Vec3(cv.clip_pos.x, cv.clip_pos.y, cv.clip_pos.z);
-    }
-
-    /* viewport transform */
-    rv.position.x = (ndc.x + 1.0f) * 0.5f * viewport_width;
-    rv.position.y = (1.0f - ndc.y) * 0.5f * viewport_height;
-    rv.position.z = (ndc.z + 1.0f) * 0.5f;
-
-    rv.world_pos = cv.world_pos;
-    rv.normal = cv.normal;
-    rv.tex_coord = cv.tex_coord;
-    rv.color = cv.color;
-
-    return rv;
-}
-
 /* render a mesh through the pipeline */
-void render_mesh(const Mesh& mesh, VertexProcessor& vertex_processor, Clipper& clipper,
-                 Rasterizer& rasterizer, int width, int height) {
-    for (size_t i = 0; i < mesh.indices.size(); i += 3) {
-        const VertexInput& v0 = mesh.vertices[mesh.indices[i]];
-        const VertexInput& v1 = mesh.vertices[mesh.indices[i + 1]];
-        const VertexInput& v2 = mesh.vertices[mesh.indices[i + 2]];
-
-        VertexOutput out0 = vertex_processor.process_vertex(v0);
-        VertexOutput out1 = vertex_processor.process_vertex(v1);
-        VertexOutput out2 = vertex_processor.process_vertex(v2);
-
-        ClipVertex cv0 = to_clip_vertex(out0);
-        ClipVertex cv1 = to_clip_vertex(out1);
-        ClipVertex cv2 = to_clip_vertex(out2);
-
-        std::vector<ClipVertex> clipped = clipper.clip_triangle(cv0, cv1, cv2);
-
-        for (size_t j = 0; j + 2 < clipped.size(); j += 3) {
-            RasterVertex rv0 = to_raster_vertex(clipped[j], width, height);
-            RasterVertex rv1 = to_raster_vertex(clipped[j + 1], width, height);
-            RasterVertex rv2 = to_raster_vertex(clipped[j + 2], width, height);
-
-            rasterizer.draw_triangle(rv0, rv1, rv2);
-        }
+void render_mesh(const Mesh& mesh, VertexProcessor& vertex_processor, Clipper& clipper, PrimitiveAssembler& assembler,
+                 Rasterizer& rasterizer, FragmentProcessor& fragment_processor, int width, int height) {
+    /* collect clipped triangles so the rasterizer can bin them across threads; */
+    /* indexed, so shared vertices are transformed once rather than once per triangle */
+    std::vector<RasterVertex> raster_vertices;
+
+    /* untextured materials never read texture coordinates, so neither the clipper nor */
+    /* the rasterizer interpolates them, and with no mip level to pick they skip quads */
+    if (!fragment_processor.uses_textures()) {
+        assembler.assemble_indexed(mesh, vertex_processor, clipper, width, height, raster_vertices,
+                                   shader_varyings<UntexturedFragmentProcessorShader>::value);
+        rasterizer.draw_triangles_parallel(raster_vertices, UntexturedFragmentProcessorShader{fragment_processor});
+        return;
     }
+
+    /* shader passed by type so the fragment processor is inlined into the quad loop */
+    assembler.assemble_indexed(mesh, vertex_processor, clipper, width, height, raster_vertices,
+                               shader_varyings<FragmentProcessorShader>::value);
+    rasterizer.draw_triangles_parallel(raster_vertices, FragmentProcessorShader{fragment_processor});
 }
 
 /* render shadow pass - depth only from light's perspective */
-void render_shadow_pass(Scene& scene, ShadowMap& shadow_map, Clipper& clipper) {
+void render_shadow_pass(Scene& scene, ShadowMap& shadow_map, Clipper& clipper, Rasterizer& rasterizer) {
     int width = shadow_map.get_width();
     int height = shadow_map.get_height();
     Mat4 light_space = shadow_map.get_light_space_matrix();
 
+    /* perspective divide and viewport transform */
+    auto to_screen = [&](const Vec4& clip_pos) -> Vec3 {
+        Vec3 ndc;
+        if (clip_pos.w != 0) {
+            ndc = Vec3(clip_pos) / clip_pos.w;
+        } else {
+            ndc = Vec3(clip_pos);
+        }
+        return Vec3(
+            (ndc.x + 1.0f) * 0.5f * width,
+            (1.0f - ndc.y) * 0.5f * height,
+            (ndc.z + 1.0f) * 0.5f
+        );
+    };
+
+    /* depth-only draws need nothing but the positions of every caster */
+    std::vector<Vec3> positions;
+
     for (SceneObject& obj : scene.get_objects()) {
         if (!obj.visible || !obj.mesh) {
             continue;
@@ -94,81 +67,61 @@ void render_shadow_pass(Scene& scene, ShadowMap& shadow_map, Clipper& clipper) {
         Mat4 mvp = light_space * model;
 
         for (size_t i = 0; i < obj.mesh->indices.size(); i += 3) {
-            const VertexInput& v0 = obj.mesh->vertices[obj.mesh->indices[i]];
-            const VertexInput& v1 = obj.mesh->vertices[obj.mesh->indices[i + 1]];
-            const VertexInput& v2 = obj.mesh->vertices[obj.mesh->indices[i + 2]];
-
             /* transform to light clip space */
-            Vec4 clip0 = mvp * Vec4(v0.position, 1.0f);
-            Vec4 clip1 = mvp * Vec4(v1.position, 1.0f);
-            Vec4 clip2 = mvp * Vec4(v2.position, 1.0f);
+            Vec4 clip0 = mvp * Vec4(obj.mesh->vertices[obj.mesh->indices[i]].position, 1.0f);
+            Vec4 clip1 = mvp * Vec4(obj.mesh->vertices[obj.mesh->indices[i + 1]].position, 1.0f);
+            Vec4 clip2 = mvp * Vec4(obj.mesh->vertices[obj.mesh->indices[i + 2]].position, 1.0f);
+
+            /* triangles inside the light frustum need no clipping */
+            if (clipper.is_inside_frustum(clip0) && clipper.is_inside_frustum(clip1) && clipper.is_inside_frustum(clip2)) {
+                positions.push_back(to_screen(clip0));
+                positions.push_back(to_screen(clip1));
+                positions.push_back(to_screen(clip2));
+                continue;
+            }
 
-            /* create clip vertices for clipping */
             ClipVertex cv0, cv1, cv2;
             cv0.clip_pos = clip0;
             cv1.clip_pos = clip1;
             cv2.clip_pos = clip2;
 
-            std::vector<ClipVertex> clipped = clipper.clip_triangle(cv0, cv1, cv2);
-
-            /* rasterize depth only */
-            for (size_t j = 0; j + 2 < clipped.size(); j += 3) {
-                /* perspective divide and viewport transform */
-                auto to_screen = [&](const ClipVertex& cv) -> Vec3 {
-                    Vec3 ndc;
-                    if (cv.clip_pos.w != 0) {
-                        ndc = Vec3(cv.clip_pos) / cv.clip_pos.w;
-                    } else {
-                        ndc = Vec3(cv.clip_pos);
-                    }
-                    return Vec3(
-                        (ndc.x + 1.0f) * 0.5f * width,
-                        (1.0f - ndc.y) * 0.5f * height,
-                        (ndc.z + 1.0f) * 0.5f
-                    );
-                };
-
-                Vec3 p0 = to_screen(clipped[j]);
-                Vec3 p1 = to_screen(clipped[j + 1]);
-                Vec3 p2 = to_screen(clipped[j + 2]);
-
-                /* simple triangle rasterization for depth */
-                int min_x = std::max(0, static_cast<int>(std::min({p0.x, p1.x, p2.x})));
-                int max_x = std::min(width - 1, static_cast<int>(std::max({p0.x, p1.x, p2.x})));
-                int min_y = std::max(0, static_cast<int>(std::min({p0.y, p1.y, p2.y})));
-                int max_y = std::min(height - 1, static_cast<int>(std::max({p0.y, p1.y, p2.y})));
-
-                /* edge function for barycentric coordinates */
-                auto edge = [](Vec3 a, Vec3 b, Vec3 c) -> float {
-                    return (c.x - a.x) * (b.y - a.y) - (c.y - a.y) * (b.x - a.x);
-                };
-
-                float area = edge(p0, p1, p2);
-                if (std::abs(area) < 0.001f) continue;
-
-                for (int y = min_y; y <= max_y; ++y) {
-                    for (int x = min_x; x <= max_x; ++x) {
-                        Vec3 p(x + 0.5f, y + 0.5f, 0.0f);
-                        float w0 = edge(p1, p2, p) / area;
-                        float w1 = edge(p2, p0, p) / area;
-                        float w2 = edge(p0, p1, p) / area;
-
-                        if (w0 >= 0 && w1 >= 0 && w2 >= 0) {
-                            float depth = w0 * p0.z + w1 * p1.z + w2 * p2.z;
-                            shadow_map.depth_test(x, y, depth);
-                        }
-                    }
-                }
+            /* only positions matter, no attribute is interpolated at new vertices */
+            ClipVertex clipped[Clipper::MAX_CLIPPED_VERTICES];
+            int count = clipper.clip_triangle(cv0, cv1, cv2, clipped, Varyings::NONE);
+            for (int j = 0; j + 2 < count; j += 3) {
+                positions.push_back(to_screen(clipped[j].clip_pos));
+                positions.push_back(to_screen(clipped[j + 1].clip_pos));
+                positions.push_back(to_screen(clipped[j + 2].clip_pos));
             }
         }
     }
+
+    /* rasterize depth on the same tiled, parallel path as the camera passes */
+    rasterizer.draw_depth_only(positions, shadow_map);
 }
 
+/* how the opaque pass is shaded, selectable per frame */
+enum class OpaqueMode {
+    FORWARD,            /* shade every fragment that passes the depth test */
+    Z_PREPASS,          /* fill depth first, then shade only fragments equal to the stored depth */
+    VISIBILITY_BUFFER,  /* rasterize triangle ids first, then shade each visible pixel once */
+    PACKED,             /* unordered: threads split triangles, the nearest fragment wins per pixel */
+    SORT_LAST           /* threads take whole objects into private buffers, then depth-composite */
+};
+
+/* how the transparent pass is blended, selectable per frame */
+enum class TransparentMode {
+    ALPHA_BLEND,        /* alpha blending in submission order */
+    WEIGHTED_OIT        /* weighted blended order-independent transparency, any order */
+};
+
 /* render entire scene */
+/* opaque_mode and transparent_mode pick how the respective pass is shaded */
 void render_scene(Scene& scene, FrameBuffer& framebuffer,
-                  VertexProcessor& vertex_processor, Clipper& clipper,
+                  VertexProcessor& vertex_processor, Clipper& clipper, PrimitiveAssembler& assembler,
                   Rasterizer& rasterizer, FragmentProcessor& fragment_processor,
-                  bool transparent_pass) {
+                  bool transparent_pass, OpaqueMode opaque_mode = OpaqueMode::FORWARD,
+                  TransparentMode transparent_mode = TransparentMode::ALPHA_BLEND) {
     int width = framebuffer.get_width();
     int height = framebuffer.get_height();
 
@@ -180,13 +133,35 @@ void render_scene(Scene& scene, FrameBuffer& framebuffer,
     }
 
     /* configure rasterizer for this pass */
+    bool oit = transparent_mode == TransparentMode::WEIGHTED_OIT && transparent_pass;
     if (transparent_pass) {
-        rasterizer.set_blend_mode(BlendMode::ALPHA);
+        rasterizer.set_blend_mode(oit ? BlendMode::NONE : BlendMode::ALPHA);
         rasterizer.set_depth_write(false);
     } else {
         rasterizer.set_blend_mode(BlendMode::NONE);
         rasterizer.set_depth_write(true);
     }
+    rasterizer.set_depth_func(DepthFunc::LESS);
+
+    /* deferred shading: one fragment processor (material) per draw id */
+    bool deferred = opaque_mode == OpaqueMode::VISIBILITY_BUFFER && !transparent_pass;
+    bool prepass = opaque_mode == OpaqueMode::Z_PREPASS && !transparent_pass;
+    bool packed = opaque_mode == OpaqueMode::PACKED && !transparent_pass;
+    bool sort_last = opaque_mode == OpaqueMode::SORT_LAST && !transparent_pass;
+    std::vector<FragmentProcessor> draw_shaders;
+    if (deferred) {
+        rasterizer.begin_visibility_pass();
+    }
+    if (packed) {
+        rasterizer.begin_packed_pass();
+    }
+    if (oit) {
+        rasterizer.begin_oit_pass();
+    }
+
+    /* depth prepass and sort-last: assembled triangles are kept per object until all are known */
+    std::vector<std::vector<RasterVertex>> draw_vertices;
+    std::vector<Vec3> prepass_positions;
 
     /* render each visible object */
     for (SceneObject& obj : scene.get_objects()) {
@@ -206,7 +181,67 @@ void render_scene(Scene& scene, FrameBuffer& framebuffer,
         fragment_processor.set_material(obj.material);
 
         /* render the mesh */
-        render_mesh(*obj.mesh, vertex_processor, clipper, rasterizer, width, height);
+        if (deferred) {
+            std::vector<RasterVertex> raster_vertices;
+            assembler.assemble_indexed(*obj.mesh, vertex_processor, clipper, width, height, raster_vertices);
+            rasterizer.draw_triangles_visibility(raster_vertices, static_cast<uint32_t>(draw_shaders.size()),
+                                                 fragment_processor.uses_textures());
+            draw_shaders.push_back(fragment_processor);
+        } else if (prepass || sort_last) {
+            draw_vertices.emplace_back();
+            assembler.assemble_indexed(*obj.mesh, vertex_processor, clipper, width, height, draw_vertices.back());
+            if (prepass) {
+                for (const RasterVertex& v : draw_vertices.back()) {
+                    prepass_positions.push_back(v.position);
+                }
+            }
+            draw_shaders.push_back(fragment_processor);
+        } else if (packed) {
+            std::vector<RasterVertex> raster_vertices;
+            assembler.assemble_indexed(*obj.mesh, vertex_processor, clipper, width, height, raster_vertices);
+            rasterizer.draw_triangles_packed(raster_vertices, [&](const Fragment& frag) {
+                return fragment_processor.process_fragment(frag);
+            });
+        } else if (oit) {
+            std::vector<RasterVertex> raster_vertices;
+            assembler.assemble_indexed(*obj.mesh, vertex_processor, clipper, width, height, raster_vertices);
+            rasterizer.draw_triangles_oit(raster_vertices, FragmentProcessorShader{fragment_processor});
+        } else {
+            render_mesh(*obj.mesh, vertex_processor, clipper, assembler, rasterizer, fragment_processor, width, height);
+        }
+    }
+
+    /* shading pass over the visibility buffer */
+    if (deferred) {
+        rasterizer.resolve_visibility([&](uint32_t draw_id, const Fragment& frag) {
+            return draw_shaders[draw_id].process_fragment(frag);
+        });
+    }
+
+    if (packed) {
+        rasterizer.resolve_packed();
+    }
+    if (oit) {
+        rasterizer.composite_oit();
+    }
+
+    /* every object to one thread's private buffer, merged by depth afterwards */
+    if (sort_last) {
+        rasterizer.draw_objects_sort_last(draw_vertices, DrawFragmentProcessorShader{draw_shaders});
+    }
+
+    /* depth of every opaque object first, then each draw shades only the fragments */
+    /* that produced the stored depth; depths are bit-identical on both paths */
+    if (prepass) {
+        rasterizer.draw_depth_only(prepass_positions);
+
+        rasterizer.set_depth_func(DepthFunc::EQUAL);
+        rasterizer.set_depth_write(false);
+        for (size_t i = 0; i < draw_vertices.size(); i++) {
+            rasterizer.draw_triangles_parallel(draw_vertices[i], FragmentProcessorShader{draw_shaders[i]});
+        }
+        rasterizer.set_depth_func(DepthFunc::LESS);
+        rasterizer.set_depth_write(true);
     }
 }
 
@@ -273,6 +308,9 @@ void draw_sky(FrameBuffer& framebuffer, Texture& sky_texture) {
 int main() {
     const int WIDTH = 800;
     const int HEIGHT = 600;
+    const OpaqueMode OPAQUE_MODE = OpaqueMode::VISIBILITY_BUFFER;  /* deferred shading for opaque objects */
+    const TransparentMode TRANSPARENT_MODE = TransparentMode::WEIGHTED_OIT;    /* transparency in any draw order */
+    const bool USE_MSAA = false;    /* 4x multisampling, opaque objects forward shaded (or depth prepassed) */
 
     /* load teapot model */
     Model teapot_model;
@@ -309,6 +347,9 @@ int main() {
     }
     ground_texture.set_wrap_mode(WrapMode::REPEAT);
 
+    /* the ground recedes to the horizon, mip levels keep the distant grass from aliasing */
+    ground_texture.generate_mipmaps();
+
     /* create scene */
     Scene scene;
     scene.set_ambient_light(Color(0.15f, 0.15f, 0.2f, 1.0f));
@@ -392,6 +433,7 @@ int main() {
     vertex_processor.set_camera(camera);
 
     Clipper clipper;
+    PrimitiveAssembler assembler;
 
     FragmentProcessor fragment_processor;
     fragment_processor.set_camera_position(camera.get_position());
@@ -401,13 +443,16 @@ int main() {
     Rasterizer rasterizer;
     rasterizer.set_framebuffer(&framebuffer);
     rasterizer.set_backface_culling(true);
-    rasterizer.set_fragment_shader([&](const Fragment& frag) {
-        return fragment_processor.process_fragment(frag);
-    });
+
+    /* the front end shares the rasterizer's workers */
+    assembler.set_thread_pool(&rasterizer.get_thread_pool());
 
     /* render shadow pass first */
     std::cout << "Rendering shadow map..." << std::endl;
-    render_shadow_pass(scene, shadow_map, clipper);
+    rasterizer.set_backface_culling(false);     /* casters are drawn from both sides */
+    render_shadow_pass(scene, shadow_map, clipper, rasterizer);
+    rasterizer.set_backface_culling(true);
+    rasterizer.reset_stats();
 
     /* draw sky background */
     std::cout << "Drawing sky..." << std::endl;
@@ -416,13 +461,43 @@ int main() {
     /* clear only depth buffer (keep sky) */
     framebuffer.clear_depth(1.0f);
 
+    /* samples start from the sky and cleared depth */
+    rasterizer.set_msaa_enabled(USE_MSAA);
+
     /* render opaque objects first */
     std::cout << "Rendering opaque objects..." << std::endl;
-    render_scene(scene, framebuffer, vertex_processor, clipper, rasterizer, fragment_processor, false);
+    render_scene(scene, framebuffer, vertex_processor, clipper, assembler, rasterizer, fragment_processor, false,
+                 USE_MSAA && OPAQUE_MODE != OpaqueMode::Z_PREPASS ? OpaqueMode::FORWARD : OPAQUE_MODE);
 
-    /* render transparent objects with alpha blending */
+    /* render transparent objects over the opaque depth */
     std::cout << "Rendering transparent objects..." << std::endl;
-    render_scene(scene, framebuffer, vertex_processor, clipper, rasterizer, fragment_processor, true);
+    render_scene(scene, framebuffer, vertex_processor, clipper, assembler, rasterizer, fragment_processor, true, OPAQUE_MODE,
+                 TRANSPARENT_MODE);
+
+    if (USE_MSAA) {
+        rasterizer.resolve_msaa();
+        rasterizer.set_msaa_enabled(false);
+    }
+
+    /* report block classification from the hierarchical rasterizer */
+    RasterStats stats = rasterizer.get_stats();
+    std::cout << "Blocks: " << stats.blocks_accepted << " accepted, "
+              << stats.blocks_partial << " partial, "
+              << stats.blocks_rejected << " rejected, "
+              << stats.blocks_occluded << " occluded" << std::endl;
+    std::cout << "Hierarchical Z: " << stats.triangles_occluded << " triangles, "
+              << stats.tiles_occluded << " triangle tiles rejected" << std::endl;
+    std::cout << "Fragments: " << stats.fragments_shaded << " shaded, "
+              << stats.fragments_written << " written, "
+              << stats.depth_fragments << " depth-only" << std::endl;
+
+    /* report load balance of the worker threads */
+    std::vector<ThreadStats> thread_stats = rasterizer.get_thread_pool().get_thread_stats();
+    for (size_t i = 0; i < thread_stats.size(); i++) {
+        std::cout << "Thread " << i << ": busy " << thread_stats[i].busy_seconds * 1000.0 << " ms, "
+                  << "idle " << thread_stats[i].idle_seconds * 1000.0 << " ms, "
+                  << thread_stats[i].tasks_run << " tasks (" << thread_stats[i].tasks_stolen << " stolen)" << std::endl;
+    }
 
     /* save output */
     if (Output::save(framebuffer, "output/render.ppm")) {
@@ -1,4 +1,5 @@
 #include "pipeline/clipper.h"
+#include <utility>
 
 Clipper::Clipper() {
 }
@@ -58,30 +59,33 @@ float Clipper::intersect_plane(const ClipVertex& v0, const ClipVertex& v1, ClipP
     return d0 / (d0 - d1);
 }
 
-ClipVertex Clipper::interpolate_vertex(const ClipVertex& v0, const ClipVertex& v1, float t) {
+ClipVertex Clipper::interpolate_vertex(const ClipVertex& v0, const ClipVertex& v1, float t, uint32_t varyings) {
     ClipVertex result;
 
-    /* linear interpolation of all attributes */
+    /* linear interpolation of the position and the attributes in use */
     result.clip_pos = v0.clip_pos + (v1.clip_pos - v0.clip_pos) * t;
-    result.world_pos = v0.world_pos + (v1.world_pos - v0.world_pos) * t;
-    result.normal = glm::normalize(v0.normal + (v1.normal - v0.normal) * t);
-    result.tex_coord = v0.tex_coord + (v1.tex_coord - v0.tex_coord) * t;
-    result.color = v0.color + (v1.color - v0.color) * t;
+    result.world_pos = (varyings & Varyings::WORLD_POS) ? v0.world_pos + (v1.world_pos - v0.world_pos) * t : Vec3(0.0f);
+    result.normal = (varyings & Varyings::NORMAL) ? glm::normalize(v0.normal + (v1.normal - v0.normal) * t) : Vec3(0.0f);
+    result.tex_coord = (varyings & Varyings::TEX_COORD) ? v0.tex_coord + (v1.tex_coord - v0.tex_coord) * t : Vec2(0.0f);
+    result.color = (varyings & Varyings::COLOR) ? v0.color + (v1.color - v0.color) * t : Color(0.0f);
 
     return result;
 }
 
-std::vector<ClipVertex> Clipper::clip_polygon_against_plane(const std::vector<ClipVertex>& vertices, ClipPlane plane) {
+int Clipper::clip_polygon_against_plane(const ClipVertex* vertices, int count, ClipPlane plane, uint32_t varyings, ClipVertex* out) {
     /* Sutherland-Hodgman polygon clipping */
-    if (vertices.empty()) {
-        return {};
-    }
-
-    std::vector<ClipVertex> result;
+    /* a convex polygon gains at most one vertex, but float classification is not exact, */
+    /* so every write is checked against the buffer size */
+    int result = 0;
+    auto emit = [&](const ClipVertex& v) {
+        if (result < MAX_POLYGON_VERTICES) {
+            out[result++] = v;
+        }
+    };
 
-    for (size_t i = 0; i < vertices.size(); i++) {
+    for (int i = 0; i < count; i++) {
         const ClipVertex& current = vertices[i];
-        const ClipVertex& next = vertices[(i + 1) % vertices.size()];
+        const ClipVertex& next = vertices[(i + 1) % count];
 
         bool current_inside = is_inside_plane(current.clip_pos, plane);
         bool next_inside = is_inside_plane(next.clip_pos, plane);
@@ -89,18 +93,18 @@ std::vector<ClipVertex> Clipper::clip_polygon_against_plane(const std::vector<Cl
         if (current_inside) {
             if (next_inside) {
                 /* both inside: keep next vertex */
-                result.push_back(next);
+                emit(next);
             } else {
                 /* current inside, next outside: add intersection */
                 float t = intersect_plane(current, next, plane);
-                result.push_back(interpolate_vertex(current, next, t));
+                emit(interpolate_vertex(current, next, t, varyings));
             }
         } else {
             if (next_inside) {
                 /* current outside, next inside: add intersection and next */
                 float t = intersect_plane(current, next, plane);
-                result.push_back(interpolate_vertex(current, next, t));
-                result.push_back(next);
+                emit(interpolate_vertex(current, next, t, varyings));
+                emit(next);
             }
             /* both outside: add nothing */
         }
@@ -109,9 +113,15 @@ std::vector<ClipVertex> Clipper::clip_polygon_against_plane(const std::vector<Cl
     return result;
 }
 
-std::vector<ClipVertex> Clipper::clip_triangle(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2) {
-    /* start with the input triangle as a polygon */
-    std::vector<ClipVertex> polygon = {v0, v1, v2};
+int Clipper::clip_triangle(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2, ClipVertex* out, uint32_t varyings) {
+    /* the polygon ping-pongs between two stack buffers, one plane at a time */
+    ClipVertex buffers[2][MAX_POLYGON_VERTICES];
+    ClipVertex* polygon = buffers[0];
+    ClipVertex* clipped = buffers[1];
+    polygon[0] = v0;
+    polygon[1] = v1;
+    polygon[2] = v2;
+    int count = 3;
 
     /* clip against each frustum plane (Sutherland-Hodgman) */
     static const ClipPlane planes[] = {
@@ -124,21 +134,22 @@ std::vector<ClipVertex> Clipper::clip_triangle(const ClipVertex& v0, const ClipV
     };
 
     for (ClipPlane plane : planes) {
-        polygon = clip_polygon_against_plane(polygon, plane);
+        count = clip_polygon_against_plane(polygon, count, plane, varyings, clipped);
+        std::swap(polygon, clipped);
 
         /* if polygon is completely clipped away, return empty */
-        if (polygon.size() < 3) {
-            return {};
+        if (count < 3) {
+            return 0;
         }
     }
 
     /* triangulate the resulting polygon (fan triangulation) */
-    std::vector<ClipVertex> result;
+    int result = 0;
 
-    for (size_t i = 1; i < polygon.size() - 1; i++) {
-        result.push_back(polygon[0]);
-        result.push_back(polygon[i]);
-        result.push_back(polygon[i + 1]);
+    for (int i = 1; i < count - 1; i++) {
+        out[result++] = polygon[0];
+        out[result++] = polygon[i];
+        out[result++] = polygon[i + 1];
     }
 
     return result;
@@ -155,6 +166,23 @@ bool Clipper::is_inside_frustum(const Vec4& clip_pos) {
            z >= -w && z <= w;
 }
 
+uint32_t Clipper::outcode(const Vec4& clip_pos) {
+    /* same comparisons as is_inside_plane, so codes agree with clip_triangle */
+    float x = clip_pos.x;
+    float y = clip_pos.y;
+    float z = clip_pos.z;
+    float w = clip_pos.w;
+
+    uint32_t code = 0;
+    code |= static_cast<uint32_t>(!(x >= -w)) << static_cast<int>(ClipPlane::LEFT);
+    code |= static_cast<uint32_t>(!(x <= w)) << static_cast<int>(ClipPlane::RIGHT);
+    code |= static_cast<uint32_t>(!(y >= -w)) << static_cast<int>(ClipPlane::BOTTOM);
+    code |= static_cast<uint32_t>(!(y <= w)) << static_cast<int>(ClipPlane::TOP);
+    code |= static_cast<uint32_t>(!(z >= -w)) << static_cast<int>(ClipPlane::NEAR);
+    code |= static_cast<uint32_t>(!(z <= w)) << static_cast<int>(ClipPlane::FAR);
+    return code;
+}
+
 bool Clipper::is_triangle_outside(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2) {
     /* trivial rejection: if all vertices are outside the same plane */
     static const ClipPlane planes[] = {
@@ -24,6 +24,10 @@ void FragmentProcessor::set_material(const Material& i_material) {
     material = i_material;
 }
 
+bool FragmentProcessor::uses_textures() const {
+    return material.diffuse_map != nullptr || material.specular_map != nullptr;
+}
+
 void FragmentProcessor::set_camera_position(Vec3 position) {
     camera_position = position;
 }
@@ -40,6 +44,15 @@ Color FragmentProcessor::process_fragment(const Fragment& fragment) {
     return shade_phong(fragment);
 }
 
+void FragmentProcessor::process_quad(const FragmentQuad& quad, Color* colors) {
+    /* helper lanes only fed the derivatives, they are not shaded */
+    for (int lane = 0; lane < 4; lane++) {
+        if (quad.mask >> lane & 1u) {
+            colors[lane] = shade_phong(quad.fragments[lane]);
+        }
+    }
+}
+
 Color FragmentProcessor::shade_flat(const Fragment& fragment) {
     /* simply return interpolated vertex color */
     return fragment.color;
@@ -54,7 +67,7 @@ Color FragmentProcessor::shade_phong(const Fragment& fragment) {
     /* get base color: sample diffuse texture if available, otherwise use vertex color * material */
     Color base_color;
     if (material.diffuse_map && material.diffuse_map->is_valid()) {
-        base_color = material.diffuse_map->sample(fragment.tex_coord) * fragment.color;
+        base_color = material.diffuse_map->sample(fragment.tex_coord, fragment.ddx.tex_coord, fragment.ddy.tex_coord) * fragment.color;
     } else {
         base_color = fragment.color * material.diffuse;
     }
@@ -62,7 +75,7 @@ Color FragmentProcessor::shade_phong(const Fragment& fragment) {
     /* get specular intensity from texture if available */
     Color spec_color = material.specular;
     if (material.specular_map && material.specular_map->is_valid()) {
-        spec_color = material.specular_map->sample(fragment.tex_coord);
+        spec_color = material.specular_map->sample(fragment.tex_coord, fragment.ddx.tex_coord, fragment.ddy.tex_coord);
     }
 
     /* calculate shadow factor (0 = fully lit, 1 = fully shadowed) */
@@ -0,0 +1,161 @@
+#include "pipeline/primitive_assembler.h"
+#include <algorithm>
+
+ClipVertex to_clip_vertex(const VertexOutput& v) {
+    ClipVertex cv;
+    cv.clip_pos = v.clip_pos;
+    cv.world_pos = v.world_pos;
+    cv.normal = v.normal;
+    cv.tex_coord = v.tex_coord;
+    cv.color = v.color;
+    return cv;
+}
+
+RasterVertex to_raster_vertex(const ClipVertex& cv, int viewport_width, int viewport_height) {
+    RasterVertex rv;
+
+    /* perspective divide */
+    Vec3 ndc;
+    if (cv.clip_pos.w != 0) {
+        ndc = Vec3(
+            cv.clip_pos.x / cv.clip_pos.w,
+            cv.clip_pos.y / cv.clip_pos.w,
+            cv.clip_pos.z / cv.clip_pos.w
+        );
+    } else {
+        ndc = Vec3(cv.clip_pos.x, cv.clip_pos.y, cv.clip_pos.z);
+    }
+
+    /* viewport transform */
+    rv.position.x = (ndc.x + 1.0f) * 0.5f * viewport_width;
+    rv.position.y = (1.0f - ndc.y) * 0.5f * viewport_height;
+    rv.position.z = (ndc.z + 1.0f) * 0.5f;
+
+    rv.world_pos = cv.world_pos;
+    rv.normal = cv.normal;
+    rv.tex_coord = cv.tex_coord;
+    rv.color = cv.color;
+    rv.inv_w = cv.clip_pos.w != 0 ? 1.0f / cv.clip_pos.w : 1.0f;
+
+    return rv;
+}
+
+PrimitiveAssembler::PrimitiveAssembler() :
+    thread_pool(nullptr)
+{}
+
+void PrimitiveAssembler::set_thread_pool(ThreadPool* pool) {
+    thread_pool = pool;
+}
+
+void PrimitiveAssembler::assemble_indexed(const Mesh& mesh, VertexProcessor& vertex_processor, Clipper& clipper,
+                                          int width, int height, std::vector<RasterVertex>& raster_vertices,
+                                          uint32_t varyings) {
+    size_t num_vertices = mesh.vertices.size();
+    size_t num_triangles = mesh.indices.size() / 3;
+    transformed.resize(num_vertices);
+    projected.resize(num_vertices);
+    outcodes.resize(num_vertices);
+
+    bool parallel = thread_pool != nullptr && thread_pool->get_num_threads() > 1;
+
+    /* vertex stage: once per vertex, however many triangles share it, in SIMD batches */
+    /* vertices are independent, so ranges go to any thread */
+    auto vertex_stage = [&](size_t begin, size_t end, int) {
+        vertex_processor.process_vertices(mesh.vertices.data() + begin, end - begin, transformed.data() + begin);
+        for (size_t i = begin; i < end; i++) {
+            outcodes[i] = clipper.outcode(transformed[i].clip_pos);
+            if (outcodes[i] == 0) {
+                projected[i] = to_raster_vertex(transformed[i], width, height);
+            }
+        }
+    };
+    if (parallel) {
+        thread_pool->parallel_for(num_vertices, VERTEX_GRAIN, vertex_stage);
+    } else {
+        vertex_stage(0, num_vertices, 0);
+    }
+
+    size_t num_chunks = (num_triangles + TRIANGLE_CHUNK - 1) / TRIANGLE_CHUNK;
+    if (!parallel || num_chunks <= 1) {
+        raster_vertices.reserve(raster_vertices.size() + num_triangles * 3);
+        assemble_range(mesh, clipper, 0, num_triangles, width, height, varyings, raster_vertices);
+        return;
+    }
+
+    /* assembly stage: fixed triangle ranges, each clipped into its own buffer */
+    if (chunk_vertices.size() < num_chunks) {
+        chunk_vertices.resize(num_chunks);
+    }
+    thread_pool->parallel_for(num_chunks, 1, [&](size_t begin, size_t end, int) {
+        for (size_t c = begin; c < end; c++) {
+            std::vector<RasterVertex>& out = chunk_vertices[c];
+            out.clear();
+            size_t first = c * TRIANGLE_CHUNK;
+            size_t last = std::min(first + TRIANGLE_CHUNK, num_triangles);
+            assemble_range(mesh, clipper, first, last, width, height, varyings, out);
+        }
+    });
+
+    /* concatenate in chunk order, so triangles keep their submission order for binning */
+    size_t total = raster_vertices.size();
+    for (size_t c = 0; c < num_chunks; c++) {
+        total += chunk_vertices[c].size();
+    }
+    raster_vertices.reserve(total);
+    for (size_t c = 0; c < num_chunks; c++) {
+        raster_vertices.insert(raster_vertices.end(), chunk_vertices[c].begin(), chunk_vertices[c].end());
+    }
+}
+
+void PrimitiveAssembler::assemble_range(const Mesh& mesh, Clipper& clipper, size_t first, size_t last,
+                                        int width, int height, uint32_t varyings, std::vector<RasterVertex>& out) {
+    /* primitive assembly by index */
+    for (size_t t = first; t < last; t++) {
+        unsigned int i0 = mesh.indices[t * 3];
+        unsigned int i1 = mesh.indices[t * 3 + 1];
+        unsigned int i2 = mesh.indices[t * 3 + 2];
+        uint32_t code0 = outcodes[i0];
+        uint32_t code1 = outcodes[i1];
+        uint32_t code2 = outcodes[i2];
+
+        /* all outside one plane: nothing would survive clipping */
+        if ((code0 & code1 & code2) != 0) {
+            continue;
+        }
+
+        /* inside the frustum: the clipper would return the triangle unchanged */
+        if ((code0 | code1 | code2) == 0) {
+            out.push_back(projected[i0]);
+            out.push_back(projected[i1]);
+            out.push_back(projected[i2]);
+            continue;
+        }
+
+        ClipVertex clipped[Clipper::MAX_CLIPPED_VERTICES];
+        int count = clipper.clip_triangle(transformed[i0], transformed[i1], transformed[i2], clipped, varyings);
+        for (int j = 0; j + 2 < count; j += 3) {
+            out.push_back(to_raster_vertex(clipped[j], width, height));
+            out.push_back(to_raster_vertex(clipped[j + 1], width, height));
+            out.push_back(to_raster_vertex(clipped[j + 2], width, height));
+        }
+    }
+}
+
+void PrimitiveAssembler::assemble_triangle(const VertexInput& v0, const VertexInput& v1, const VertexInput& v2,
+                                           VertexProcessor& vertex_processor, Clipper& clipper,
+                                           int width, int height, std::vector<RasterVertex>& raster_vertices,
+                                           uint32_t varyings) {
+    ClipVertex cv0 = to_clip_vertex(vertex_processor.process_vertex(v0));
+    ClipVertex cv1 = to_clip_vertex(vertex_processor.process_vertex(v1));
+    ClipVertex cv2 = to_clip_vertex(vertex_processor.process_vertex(v2));
+
+    ClipVertex clipped[Clipper::MAX_CLIPPED_VERTICES];
+    int count = clipper.clip_triangle(cv0, cv1, cv2, clipped, varyings);
+
+    for (int j = 0; j + 2 < count; j += 3) {
+        raster_vertices.push_back(to_raster_vertex(clipped[j], width, height));
+        raster_vertices.push_back(to_raster_vertex(clipped[j + 1], width, height));
+        raster_vertices.push_back(to_raster_vertex(clipped[j + 2], width, height));
+    }
+}
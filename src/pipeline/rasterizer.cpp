@@ -1,6 +1,128 @@
 #include "pipeline/rasterizer.h"
 #include <algorithm>
 #include <cmath>
+#include <limits>
+#include <bitset>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define RASTERIZER_AVX2_KERNEL 1
+#endif
+
+/* MSAA sample positions relative to the pixel center, in subpixel units (1/256 pixel) */
+static const int64_t msaa_sample_offsets[Rasterizer::MSAA_SAMPLES][2] = {{-32, -96}, {96, -32}, {-96, 32}, {32, 96}};
+static const int64_t msaa_sample_extent = 96;
+
+/* per-lane pixel offsets within an 8-wide span */
+static const float span_lane_offsets[Rasterizer::SPAN_WIDTH] = {0, 1, 2, 3, 4, 5, 6, 7};
+
+/* scalar early depth test for up to 8 consecutive pixels, bit i set if pixel i passes */
+static uint32_t depth_mask_scalar(const TriangleSetup& setup, float depth, const float* depth_row, int count, bool test_depth, DepthFunc func) {
+    uint32_t mask = 0;
+    for (int i = 0; i < count; i++) {
+        float z = depth + setup.depth_dx * span_lane_offsets[i];
+        bool pass = func == DepthFunc::EQUAL ? z == depth_row[i] : z < depth_row[i];
+        if (!test_depth || pass) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+}
+
+/* scalar store of the interpolated depth for the lanes set in mask */
+static void store_depth_scalar(float depth, float depth_dx, float* depth_row, uint32_t mask) {
+    for (int i = 0; mask != 0; i++, mask >>= 1) {
+        if (mask & 1u) {
+            depth_row[i] = depth + depth_dx * span_lane_offsets[i];
+        }
+    }
+}
+
+/* scalar coverage (+ early depth) test, exact integer edge functions */
+static uint32_t coverage_mask_scalar(const TriangleSetup& setup, const int64_t* w, float depth, const float* depth_row, int count, bool test_depth, DepthFunc func) {
+    uint32_t inside = 0;
+    for (int i = 0; i < count; i++) {
+        if (w[0] + setup.edge_dx[0] * i >= 0 && w[1] + setup.edge_dx[1] * i >= 0 && w[2] + setup.edge_dx[2] * i >= 0) {
+            inside |= 1u << i;
+        }
+    }
+    return inside & depth_mask_scalar(setup, depth, depth_row, count, test_depth, func);
+}
+
+#ifdef RASTERIZER_AVX2_KERNEL
+/* AVX2 early depth test for 8 consecutive pixels, lanes past count are masked off */
+__attribute__((target("avx2")))
+static uint32_t depth_mask_avx2(const TriangleSetup& setup, float depth, const float* depth_row, int count, bool test_depth, DepthFunc func) {
+    const __m256 lanes = _mm256_loadu_ps(span_lane_offsets);
+
+    __m256i valid = _mm256_cmpgt_epi32(_mm256_set1_epi32(count), _mm256_cvtps_epi32(lanes));
+    if (!test_depth) {
+        return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(valid)));
+    }
+
+    /* only load depth for lanes inside the span, so the row end is never overrun */
+    __m256 stored = _mm256_maskload_ps(depth_row, valid);
+
+    __m256 z = _mm256_add_ps(_mm256_set1_ps(depth), _mm256_mul_ps(lanes, _mm256_set1_ps(setup.depth_dx)));
+    __m256 compare = func == DepthFunc::EQUAL ? _mm256_cmp_ps(z, stored, _CMP_EQ_OQ) : _mm256_cmp_ps(z, stored, _CMP_LT_OQ);
+    __m256 pass = _mm256_and_ps(compare, _mm256_castsi256_ps(valid));
+    return static_cast<uint32_t>(_mm256_movemask_ps(pass));
+}
+
+/* AVX2 masked store of the interpolated depth, lanes outside mask are left untouched */
+__attribute__((target("avx2")))
+static void store_depth_avx2(float depth, float depth_dx, float* depth_row, uint32_t mask) {
+    const __m256 lanes = _mm256_loadu_ps(span_lane_offsets);
+    const __m256i lane_bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    __m256i selected = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(static_cast<int>(mask)), lane_bits), lane_bits);
+    __m256 z = _mm256_add_ps(_mm256_set1_ps(depth), _mm256_mul_ps(lanes, _mm256_set1_ps(depth_dx)));
+    _mm256_maskstore_ps(depth_row, selected, z);
+}
+
+/* AVX2 coverage (+ early depth) test: 64-bit edge values, 4 lanes per register */
+__attribute__((target("avx2")))
+static uint32_t coverage_mask_avx2(const TriangleSetup& setup, const int64_t* w, float depth, const float* depth_row, int count, bool test_depth, DepthFunc func) {
+    const __m256i minus_one = _mm256_set1_epi64x(-1);
+    __m256i inside_lo = _mm256_set1_epi64x(-1);
+    __m256i inside_hi = _mm256_set1_epi64x(-1);
+
+    for (int e = 0; e < 3; e++) {
+        int64_t step = setup.edge_dx[e];
+        __m256i lo = _mm256_set_epi64x(w[e] + 3 * step, w[e] + 2 * step, w[e] + step, w[e]);
+        __m256i hi = _mm256_add_epi64(lo, _mm256_set1_epi64x(4 * step));
+        inside_lo = _mm256_and_si256(inside_lo, _mm256_cmpgt_epi64(lo, minus_one));
+        inside_hi = _mm256_and_si256(inside_hi, _mm256_cmpgt_epi64(hi, minus_one));
+    }
+
+    /* one sign bit per 64-bit lane, lanes 0-3 then 4-7 */
+    uint32_t inside = static_cast<uint32_t>(_mm256_movemask_pd(_mm256_castsi256_pd(inside_lo)))
+                    | static_cast<uint32_t>(_mm256_movemask_pd(_mm256_castsi256_pd(inside_hi))) << 4;
+    return inside & depth_mask_avx2(setup, depth, depth_row, count, test_depth, func);
+}
+#endif
+
+/* store depth for the lanes set in mask, AVX2 when enabled */
+static void store_depth(bool use_avx2, float depth, float depth_dx, float* depth_row, uint32_t mask) {
+#ifdef RASTERIZER_AVX2_KERNEL
+    if (use_avx2) {
+        store_depth_avx2(depth, depth_dx, depth_row, mask);
+        return;
+    }
+#else
+    (void)use_avx2;
+#endif
+    store_depth_scalar(depth, depth_dx, depth_row, mask);
+}
+
+/* runtime CPU feature check for the AVX2 kernel */
+static bool cpu_supports_avx2() {
+#ifdef RASTERIZER_AVX2_KERNEL
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
 
 Rasterizer::Rasterizer() {
     framebuffer = nullptr;
@@ -9,12 +131,34 @@ Rasterizer::Rasterizer() {
     backface_culling = true;
     blend_mode = BlendMode::NONE;
     depth_write = true;
-    num_threads = std::thread::hardware_concurrency();
-    if (num_threads == 0) num_threads = 4;
+    depth_func = DepthFunc::LESS;
+    num_threads = thread_pool.get_num_threads();
+    tiles_x = 0;
+    tiles_y = 0;
+    bin_width = 0;
+    bin_height = 0;
+    simd_enabled = cpu_supports_avx2();
+    early_depth_test = true;
+    quad_shading = true;
+    small_triangle_path = true;
+    visibility_pass = false;
+    packed_pass = false;
+    packed_size = 0;
+    oit_pass = false;
+    msaa_enabled = false;
 }
 
 void Rasterizer::set_framebuffer(FrameBuffer* fb) {
     framebuffer = fb;
+
+    /* samples always mirror the bound framebuffer's size and contents */
+    if (msaa_enabled) {
+        if (framebuffer != nullptr) {
+            clear_msaa();
+        } else {
+            msaa_enabled = false;
+        }
+    }
 }
 
 void Rasterizer::set_fragment_shader(FragmentShader shader) {
@@ -37,6 +181,46 @@ void Rasterizer::set_depth_write(bool enabled) {
     depth_write = enabled;
 }
 
+void Rasterizer::set_depth_func(DepthFunc func) {
+    depth_func = func;
+}
+
+void Rasterizer::set_simd_enabled(bool enabled) {
+    simd_enabled = enabled && cpu_supports_avx2();
+}
+
+bool Rasterizer::is_simd_enabled() const {
+    return simd_enabled;
+}
+
+void Rasterizer::set_early_depth_test(bool enabled) {
+    early_depth_test = enabled;
+}
+
+void Rasterizer::set_quad_shading(bool enabled) {
+    quad_shading = enabled;
+}
+
+bool Rasterizer::is_quad_shading() const {
+    return quad_shading;
+}
+
+void Rasterizer::set_small_triangle_path(bool enabled) {
+    small_triangle_path = enabled;
+}
+
+bool Rasterizer::is_small_triangle_path() const {
+    return small_triangle_path;
+}
+
+RasterStats Rasterizer::get_stats() const {
+    return stats;
+}
+
+void Rasterizer::reset_stats() {
+    stats = RasterStats();
+}
+
 void Rasterizer::set_num_threads(int threads) {
     if (threads <= 0) {
         num_threads = std::thread::hardware_concurrency();
@@ -44,21 +228,72 @@ void Rasterizer::set_num_threads(int threads) {
     } else {
         num_threads = threads;
     }
+    if (num_threads != thread_pool.get_num_threads()) {
+        thread_pool.resize(num_threads);
+    }
 }
 
-void Rasterizer::write_pixel_safe(int x, int y, float depth, const Color& color) {
-    std::lock_guard<std::mutex> lock(framebuffer_mutex);
-    float current_depth = framebuffer->get_depth(x, y);
-    if (depth < current_depth) {
-        if (blend_mode == BlendMode::NONE) {
-            framebuffer->set_pixel(x, y, color);
-        } else {
-            framebuffer->set_pixel_blended(x, y, color, blend_mode);
-        }
-        if (depth_write) {
-            framebuffer->set_depth(x, y, depth);
+void Rasterizer::set_msaa_enabled(bool enabled) {
+    bool was_enabled = msaa_enabled;
+    msaa_enabled = enabled && framebuffer != nullptr;
+    if (msaa_enabled && !was_enabled) {
+        clear_msaa();
+    }
+}
+
+void Rasterizer::clear_msaa() {
+    if (framebuffer == nullptr) {
+        return;
+    }
+
+    /* every sample starts as the pixel it belongs to */
+    const std::vector<Color>& color_buffer = framebuffer->get_color_buffer();
+    const std::vector<float>& depth_buffer = framebuffer->get_depth_buffer();
+    sample_color.resize(color_buffer.size() * MSAA_SAMPLES);
+    sample_depth.resize(depth_buffer.size() * MSAA_SAMPLES);
+
+    int width = framebuffer->get_width();
+    thread_pool.parallel_for(framebuffer->get_height(), 1, [&](size_t begin, size_t end, int) {
+        for (size_t i = begin * width; i < end * width; i++) {
+            for (int s = 0; s < MSAA_SAMPLES; s++) {
+                sample_color[i * MSAA_SAMPLES + s] = color_buffer[i];
+                sample_depth[i * MSAA_SAMPLES + s] = depth_buffer[i];
+            }
         }
+    });
+}
+
+bool Rasterizer::is_msaa_enabled() const {
+    return msaa_enabled;
+}
+
+void Rasterizer::resolve_msaa() {
+    if (framebuffer == nullptr || !msaa_enabled) {
+        return;
     }
+
+    int width = framebuffer->get_width();
+    std::vector<Color>& color_buffer = framebuffer->get_color_buffer();
+    std::vector<float>& depth_buffer = framebuffer->get_depth_buffer();
+
+    for_each_depth_block_row([&](int y0, int y1) {
+        for (int i = y0 * width; i < y1 * width; i++) {
+            const Color* colors = &sample_color[static_cast<size_t>(i) * MSAA_SAMPLES];
+            const float* depths = &sample_depth[static_cast<size_t>(i) * MSAA_SAMPLES];
+            Color sum = colors[0];
+            float nearest = depths[0];
+            for (int s = 1; s < MSAA_SAMPLES; s++) {
+                sum += colors[s];
+                nearest = std::min(nearest, depths[s]);
+            }
+            color_buffer[i] = sum / static_cast<float>(MSAA_SAMPLES);
+            depth_buffer[i] = nearest;
+        }
+    });
+}
+
+ThreadPool& Rasterizer::get_thread_pool() {
+    return thread_pool;
 }
 
 float Rasterizer::edge_function(Vec2 a, Vec2 b, Vec2 c) {
@@ -66,121 +301,215 @@ float Rasterizer::edge_function(Vec2 a, Vec2 b, Vec2 c) {
     return (c.x - a.x) * (b.y - a.y) - (c.y - a.y) * (b.x - a.x);
 }
 
-Fragment Rasterizer::interpolate_fragment(Vec3 bary, const RasterVertex& v0, const RasterVertex& v1, const RasterVertex& v2, Vec3 screen_pos) {
-    Fragment frag;
-
-    float w0 = bary.x;
-    float w1 = bary.y;
-    float w2 = bary.z;
+uint32_t Rasterizer::span_mask(const TriangleSetup& setup, const int64_t* w, float depth, const float* depth_row, int count, bool fully_inside, bool test_depth, DepthFunc func) const {
+#ifdef RASTERIZER_AVX2_KERNEL
+    if (simd_enabled) {
+        return fully_inside ? depth_mask_avx2(setup, depth, depth_row, count, test_depth, func)
+                            : coverage_mask_avx2(setup, w, depth, depth_row, count, test_depth, func);
+    }
+#endif
+    return fully_inside ? depth_mask_scalar(setup, depth, depth_row, count, test_depth, func)
+                        : coverage_mask_scalar(setup, w, depth, depth_row, count, test_depth, func);
+}
 
-    frag.screen_pos = screen_pos;
-    frag.world_pos = v0.world_pos * w0 + v1.world_pos * w1 + v2.world_pos * w2;
-    frag.normal = glm::normalize(v0.normal * w0 + v1.normal * w1 + v2.normal * w2);
-    frag.tex_coord = v0.tex_coord * w0 + v1.tex_coord * w1 + v2.tex_coord * w2;
-    frag.color = v0.color * w0 + v1.color * w1 + v2.color * w2;
+uint16_t Rasterizer::small_coverage_mask(const TriangleSetup& setup) const {
+    int width = setup.max_x - setup.min_x + 1;
+    int height = setup.max_y - setup.min_y + 1;
 
-    return frag;
+    /* every lane of the footprint is evaluated and combined with bit operations, */
+    /* so the loop has fixed trip counts and no data-dependent branches */
+    uint32_t mask = 0;
+    for (int y = 0; y < SMALL_TRIANGLE_SIZE; y++) {
+        for (int x = 0; x < SMALL_TRIANGLE_SIZE; x++) {
+            uint32_t inside = static_cast<uint32_t>(x < width) & static_cast<uint32_t>(y < height);
+            for (int e = 0; e < 3; e++) {
+                int64_t w = setup.edge_origin[e] + setup.edge_dx[e] * x + setup.edge_dy[e] * y;
+                inside &= static_cast<uint32_t>(w >= 0);
+            }
+            mask |= inside << (y * SMALL_TRIANGLE_SIZE + x);
+        }
+    }
+    return static_cast<uint16_t>(mask);
 }
 
-void Rasterizer::draw_triangle(const RasterVertex& v0, const RasterVertex& v1, const RasterVertex& v2) {
-    if (framebuffer == nullptr) {
-        return;
+/* 1/w followed by the vertex attributes of a varying set divided by w, packed like TriangleSetup */
+static int pack_varyings(const RasterVertex& v, uint32_t varyings, float* out) {
+    float inv_w = v.inv_w;
+    int n = 0;
+    out[n++] = inv_w;
+    if (varyings & Varyings::WORLD_POS) {
+        out[n++] = v.world_pos.x * inv_w;
+        out[n++] = v.world_pos.y * inv_w;
+        out[n++] = v.world_pos.z * inv_w;
     }
+    if (varyings & Varyings::NORMAL) {
+        out[n++] = v.normal.x * inv_w;
+        out[n++] = v.normal.y * inv_w;
+        out[n++] = v.normal.z * inv_w;
+    }
+    if (varyings & Varyings::TEX_COORD) {
+        out[n++] = v.tex_coord.x * inv_w;
+        out[n++] = v.tex_coord.y * inv_w;
+    }
+    if (varyings & Varyings::COLOR) {
+        out[n++] = v.color.r * inv_w;
+        out[n++] = v.color.g * inv_w;
+        out[n++] = v.color.b * inv_w;
+        out[n++] = v.color.a * inv_w;
+    }
+    return n;
+}
 
-    /* get screen positions */
-    Vec2 p0 = Vec2(v0.position.x, v0.position.y);
-    Vec2 p1 = Vec2(v1.position.x, v1.position.y);
-    Vec2 p2 = Vec2(v2.position.x, v2.position.y);
+bool Rasterizer::setup_edges(const Vec3& p0, const Vec3& p1, const Vec3& p2, int width, int height, bool multisample, TriangleSetup& setup, BarycentricPlanes& bary) {
+    /* snap to the fixed-point grid, coverage is decided exactly on the snapped positions */
+    const Vec3* p[3] = {&p0, &p1, &p2};
+    const float subpixel_scale = static_cast<float>(1 << SUBPIXEL_BITS);
+    int64_t px[3], py[3];
+    for (int i = 0; i < 3; i++) {
+        px[i] = static_cast<int64_t>(std::floor(p[i]->x * subpixel_scale + 0.5f));
+        py[i] = static_cast<int64_t>(std::floor(p[i]->y * subpixel_scale + 0.5f));
+    }
 
-    /* calculate signed area (2x) using edge function */
-    float area = edge_function(p0, p1, p2);
+    /* signed area (2x), same orientation as edge_function(p0, p1, p2) */
+    int64_t area = (px[2] - px[0]) * (py[1] - py[0]) - (py[2] - py[0]) * (px[1] - px[0]);
 
     /* backface culling: if area is negative, triangle faces away */
     if (backface_culling && area < 0) {
-        return;
+        return false;
     }
 
     /* degenerate triangle check */
-    if (std::abs(area) < 0.0001f) {
-        return;
-    }
-
-    /* wireframe mode: just draw edges */
-    if (wireframe_mode) {
-        draw_line(static_cast<int>(p0.x), static_cast<int>(p0.y),
-                  static_cast<int>(p1.x), static_cast<int>(p1.y), v0.color);
-        draw_line(static_cast<int>(p1.x), static_cast<int>(p1.y),
-                  static_cast<int>(p2.x), static_cast<int>(p2.y), v1.color);
-        draw_line(static_cast<int>(p2.x), static_cast<int>(p2.y),
-                  static_cast<int>(p0.x), static_cast<int>(p0.y), v2.color);
-        return;
+    if (area == 0) {
+        return false;
     }
 
-    /* compute bounding box of triangle */
-    int min_x = static_cast<int>(std::floor(std::min({p0.x, p1.x, p2.x})));
-    int min_y = static_cast<int>(std::floor(std::min({p0.y, p1.y, p2.y})));
-    int max_x = static_cast<int>(std::ceil(std::max({p0.x, p1.x, p2.x})));
-    int max_y = static_cast<int>(std::ceil(std::max({p0.y, p1.y, p2.y})));
+    /* pixel x is sampled at x + 0.5: the box spans the first and last centers inside the vertex range, */
+    /* widened by the sample pattern when multisampling */
+    const int64_t half_pixel = int64_t(1) << (SUBPIXEL_BITS - 1);
+    const int64_t pixel_mask = (int64_t(1) << SUBPIXEL_BITS) - 1;
+    const int64_t extent = multisample ? msaa_sample_extent : 0;
+    int64_t box_min_x = (std::min({px[0], px[1], px[2]}) - half_pixel - extent + pixel_mask) >> SUBPIXEL_BITS;
+    int64_t box_min_y = (std::min({py[0], py[1], py[2]}) - half_pixel - extent + pixel_mask) >> SUBPIXEL_BITS;
+    int64_t box_max_x = (std::max({px[0], px[1], px[2]}) - half_pixel + extent) >> SUBPIXEL_BITS;
+    int64_t box_max_y = (std::max({py[0], py[1], py[2]}) - half_pixel + extent) >> SUBPIXEL_BITS;
 
     /* clip bounding box to screen */
-    min_x = std::max(min_x, 0);
-    min_y = std::max(min_y, 0);
-    max_x = std::min(max_x, framebuffer->get_width() - 1);
-    max_y = std::min(max_y, framebuffer->get_height() - 1);
-
-    /* inverse of area for barycentric normalization */
-    float inv_area = 1.0f / area;
-
-    /* rasterize: iterate over all pixels in bounding box */
-    for (int y = min_y; y <= max_y; y++) {
-        for (int x = min_x; x <= max_x; x++) {
-            /* sample at pixel center */
-            Vec2 p = Vec2(x + 0.5f, y + 0.5f);
-
-            /* compute barycentric coordinates using edge functions */
-            float w0 = edge_function(p1, p2, p) * inv_area;
-            float w1 = edge_function(p2, p0, p) * inv_area;
-            float w2 = edge_function(p0, p1, p) * inv_area;
-
-            /* check if point is inside triangle (all weights >= 0) */
-            if (w0 >= 0 && w1 >= 0 && w2 >= 0) {
-                /* interpolate depth */
-                float depth = w0 * v0.position.z + w1 * v1.position.z + w2 * v2.position.z;
-
-                /* depth test - for blending, still test but may not write */
-                float current_depth = framebuffer->get_depth(x, y);
-                if (depth < current_depth) {
-                    /* create fragment with interpolated attributes */
-                    Vec3 bary = Vec3(w0, w1, w2);
-                    Vec3 screen_pos = Vec3(x, y, depth);
-                    Fragment frag = interpolate_fragment(bary, v0, v1, v2, screen_pos);
-
-                    /* compute final color */
-                    Color color;
-                    if (fragment_shader) {
-                        color = fragment_shader(frag);
-                    } else {
-                        color = frag.color;
-                    }
+    setup.min_x = static_cast<int>(std::max<int64_t>(box_min_x, 0));
+    setup.min_y = static_cast<int>(std::max<int64_t>(box_min_y, 0));
+    setup.max_x = static_cast<int>(std::min<int64_t>(box_max_x, width - 1));
+    setup.max_y = static_cast<int>(std::min<int64_t>(box_max_y, height - 1));
 
-                    /* write to framebuffer with blending */
-                    if (blend_mode == BlendMode::NONE) {
-                        framebuffer->set_pixel(x, y, color);
-                    } else {
-                        framebuffer->set_pixel_blended(x, y, color, blend_mode);
-                    }
+    /* edge i runs from vertex i+1 to i+2: e(p) = (p.x - a.x) * (b.y - a.y) - (p.y - a.y) * (b.x - a.x) */
+    /* flipped for clockwise triangles so the inside is always e >= 0 */
+    int64_t orientation = area > 0 ? 1 : -1;
+    int64_t origin_x = (int64_t(setup.min_x) << SUBPIXEL_BITS) + half_pixel;
+    int64_t origin_y = (int64_t(setup.min_y) << SUBPIXEL_BITS) + half_pixel;
+    double inv_area = 1.0 / static_cast<double>(area * orientation);
 
-                    /* update depth buffer if depth writing is enabled */
-                    if (depth_write) {
-                        framebuffer->set_depth(x, y, depth);
-                    }
-                }
-            }
+    for (int i = 0; i < 3; i++) {
+        int a = (i + 1) % 3;
+        int b = (i + 2) % 3;
+        int64_t step_x = (py[b] - py[a]) * orientation;
+        int64_t step_y = (px[a] - px[b]) * orientation;
+        int64_t origin = step_x * (origin_x - px[a]) + step_y * (origin_y - py[a]);
+
+        setup.edge_dx[i] = step_x << SUBPIXEL_BITS;
+        setup.edge_dy[i] = step_y << SUBPIXEL_BITS;
+
+        /* top-left rule: a pixel center exactly on an edge belongs to the triangle only */
+        /* if that is a left edge (inside to its right) or a top edge (horizontal, inside below) */
+        bool top_left = step_x > 0 || (step_x == 0 && step_y > 0);
+        setup.edge_origin[i] = top_left ? origin : origin - 1;
+
+        /* normalized, the unbiased edge values are the barycentrics of the snapped triangle */
+        bary.dx[i] = static_cast<float>(static_cast<double>(setup.edge_dx[i]) * inv_area);
+        bary.dy[i] = static_cast<float>(static_cast<double>(setup.edge_dy[i]) * inv_area);
+        bary.origin[i] = static_cast<float>(static_cast<double>(origin) * inv_area);
+
+        /* edge values move by step * offset from the center to each sample */
+        setup.sample_min_offset[i] = 0;
+        setup.sample_max_offset[i] = 0;
+        for (int s = 0; s < MSAA_SAMPLES; s++) {
+            int64_t offset = multisample ? step_x * msaa_sample_offsets[s][0] + step_y * msaa_sample_offsets[s][1] : 0;
+            setup.sample_edge_offset[i][s] = offset;
+            setup.sample_min_offset[i] = std::min(setup.sample_min_offset[i], offset);
+            setup.sample_max_offset[i] = std::max(setup.sample_max_offset[i], offset);
         }
     }
+
+    /* small triangles resolve the coverage of their whole footprint here; one that */
+    /* covers no pixel center needs no depth or varying setup, binning drops it */
+    setup.small = small_triangle_path && !multisample && setup.min_x <= setup.max_x && setup.max_x - setup.min_x < SMALL_TRIANGLE_SIZE
+               && setup.min_y <= setup.max_y && setup.max_y - setup.min_y < SMALL_TRIANGLE_SIZE;
+    setup.small_coverage = 0;
+    if (setup.small) {
+        setup.small_coverage = small_coverage_mask(setup);
+        if (setup.small_coverage == 0) {
+            return true;
+        }
+    }
+
+    /* depth is the barycentric blend of vertex depths, so it steps linearly as well */
+    Vec3 z = Vec3(p0.z, p1.z, p2.z);
+    setup.depth_dx = glm::dot(bary.dx, z);
+    setup.depth_dy = glm::dot(bary.dy, z);
+    setup.depth_origin = glm::dot(bary.origin, z);
+    setup.min_depth = std::min({p0.z, p1.z, p2.z});
+    for (int s = 0; s < MSAA_SAMPLES; s++) {
+        float offset_x = static_cast<float>(msaa_sample_offsets[s][0]) / static_cast<float>(1 << SUBPIXEL_BITS);
+        float offset_y = static_cast<float>(msaa_sample_offsets[s][1]) / static_cast<float>(1 << SUBPIXEL_BITS);
+        setup.sample_depth_offset[s] = multisample ? setup.depth_dx * offset_x + setup.depth_dy * offset_y : 0.0f;
+    }
+
+    return true;
+}
+
+bool Rasterizer::setup_triangle(const RasterVertex& v0, const RasterVertex& v1, const RasterVertex& v2, uint32_t varyings, TriangleSetup& setup) {
+    BarycentricPlanes bary;
+    if (!setup_edges(v0.position, v1.position, v2.position, framebuffer->get_width(), framebuffer->get_height(), msaa_enabled, setup, bary)) {
+        return false;
+    }
+
+    setup.v0 = &v0;
+    setup.v1 = &v1;
+    setup.v2 = &v2;
+    if (setup.small && setup.small_coverage == 0) {
+        return true;
+    }
+
+    /* attribute/w is linear in screen space, so each declared one gets a plane like depth */
+    float values[3][TriangleSetup::NUM_VARYINGS];
+    int count = pack_varyings(v0, varyings, values[0]);
+    pack_varyings(v1, varyings, values[1]);
+    pack_varyings(v2, varyings, values[2]);
+    for (int i = 0; i < count; i++) {
+        Vec3 a = Vec3(values[0][i], values[1][i], values[2][i]);
+        setup.varying_dx[i] = glm::dot(bary.dx, a);
+        setup.varying_dy[i] = glm::dot(bary.dy, a);
+        setup.varying_origin[i] = glm::dot(bary.origin, a);
+    }
+
+    return true;
+}
+
+void Rasterizer::draw_triangle(const RasterVertex& v0, const RasterVertex& v1, const RasterVertex& v2) {
+    draw_triangle(v0, v1, v2, FunctionShader{fragment_shader});
 }
 
 void Rasterizer::draw_line(int x0, int y0, int x1, int y1, Color color) {
+    /* multisampled, lines cover every sample of their pixels so the resolve keeps them */
+    auto plot = [&](int x, int y) {
+        if (!msaa_enabled) {
+            framebuffer->set_pixel(x, y, color);
+            return;
+        }
+        if (x < 0 || x >= framebuffer->get_width() || y < 0 || y >= framebuffer->get_height()) {
+            return;
+        }
+        size_t first = (static_cast<size_t>(y) * framebuffer->get_width() + x) * MSAA_SAMPLES;
+        std::fill(sample_color.begin() + first, sample_color.begin() + first + MSAA_SAMPLES, color);
+    };
+
     /* midpoint line algorithm - incremental variant */
     int dx = x1 - x0;
     int dy = y1 - y0;
@@ -191,7 +520,7 @@ void Rasterizer::draw_line(int x0, int y0, int x1, int y1, Color color) {
     dx = std::abs(dx);
     dy = std::abs(dy);
 
-    framebuffer->set_pixel(x0, y0, color);
+    plot(x0, y0);
 
     if (dx >= dy) {
         /* x is the driving axis */
@@ -207,7 +536,7 @@ void Rasterizer::draw_line(int x0, int y0, int x1, int y1, Color color) {
                 y0 += step_y;
             }
             x0 += step_x;
-            framebuffer->set_pixel(x0, y0, color);
+            plot(x0, y0);
         }
     } else {
         /* y is the driving axis */
@@ -223,95 +552,544 @@ void Rasterizer::draw_line(int x0, int y0, int x1, int y1, Color color) {
                 x0 += step_x;
             }
             y0 += step_y;
-            framebuffer->set_pixel(x0, y0, color);
+            plot(x0, y0);
+        }
+    }
+}
+
+void Rasterizer::begin_binning(int width, int height, FrameBuffer* hiz) {
+    /* resize tile grid to match the target */
+    bin_width = width;
+    bin_height = height;
+    tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+    tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+    tile_bins.resize(tiles_x * tiles_y);
+    for (auto& bin : tile_bins) {
+        bin.clear();
+    }
+    triangle_setups.clear();
+    tile_cost.assign(tiles_x * tiles_y, 0);
+
+    /* targets without hierarchical Z never reject a tile */
+    if (hiz == nullptr) {
+        tile_max_depth.assign(tiles_x * tiles_y, std::numeric_limits<float>::infinity());
+        return;
+    }
+
+    /* coarse max depth per tile, from the framebuffer's hierarchical Z blocks */
+    int blocks_x = hiz->get_blocks_x();
+    int blocks_y = hiz->get_blocks_y();
+    int blocks_per_tile = TILE_SIZE / BLOCK_SIZE;
+    tile_max_depth.assign(tiles_x * tiles_y, 0.0f);
+    for (int by = 0; by < blocks_y; by++) {
+        for (int bx = 0; bx < blocks_x; bx++) {
+            float& tile_max = tile_max_depth[(by / blocks_per_tile) * tiles_x + bx / blocks_per_tile];
+            tile_max = std::max(tile_max, hiz->get_block_max_depth(bx, by));
+        }
+    }
+}
+
+void Rasterizer::bin_setup(const TriangleSetup& setup) {
+    /* off-screen triangles and small ones missing every pixel center cover no tiles */
+    if (setup.min_x > setup.max_x || setup.min_y > setup.max_y || (setup.small && setup.small_coverage == 0)) {
+        return;
+    }
+
+    uint32_t setup_index = static_cast<uint32_t>(triangle_setups.size());
+
+    /* append to every overlapped tile that is not fully occluding it, keeping submission order */
+    int tile_min_x = setup.min_x / TILE_SIZE;
+    int tile_min_y = setup.min_y / TILE_SIZE;
+    int tile_max_x = setup.max_x / TILE_SIZE;
+    int tile_max_y = setup.max_y / TILE_SIZE;
+    bool binned = false;
+
+    for (int ty = tile_min_y; ty <= tile_max_y; ty++) {
+        for (int tx = tile_min_x; tx <= tile_max_x; tx++) {
+            int tile = ty * tiles_x + tx;
+            if (early_depth_test && !msaa_enabled && depth_occluded(depth_func, setup.min_depth, tile_max_depth[tile])) {
+                stats.tiles_occluded++;
+                continue;
+            }
+            tile_bins[tile].push_back(setup_index);
+            binned = true;
+
+            /* bounding box overlap is a cheap upper bound of the work in this tile */
+            int overlap_x = std::min(setup.max_x, tx * TILE_SIZE + TILE_SIZE - 1) - std::max(setup.min_x, tx * TILE_SIZE) + 1;
+            int overlap_y = std::min(setup.max_y, ty * TILE_SIZE + TILE_SIZE - 1) - std::max(setup.min_y, ty * TILE_SIZE) + 1;
+            tile_cost[tile] += static_cast<uint32_t>(overlap_x * overlap_y);
+        }
+    }
+
+    if (binned) {
+        triangle_setups.push_back(setup);
+    } else {
+        stats.triangles_occluded++;
+    }
+}
+
+void Rasterizer::bin_triangles(const RasterVertex* vertices, size_t num_triangles, uint32_t first_triangle_id, uint32_t varyings) {
+    begin_binning(framebuffer->get_width(), framebuffer->get_height(), framebuffer);
+    triangle_setups.reserve(num_triangles);
+
+    for (size_t i = 0; i < num_triangles; i++) {
+        TriangleSetup setup;
+        if (!setup_triangle(vertices[i * 3], vertices[i * 3 + 1], vertices[i * 3 + 2], varyings, setup)) {
+            continue;
+        }
+        setup.triangle_id = first_triangle_id + static_cast<uint32_t>(i);
+        bin_setup(setup);
+    }
+}
+
+void Rasterizer::build_tile_tasks() {
+    /* one task per non-empty tile; heavy tiles become one task per sub-tile so the */
+    /* work of a large or dense region can be stolen by idle threads */
+    tile_tasks.clear();
+    for (size_t idx = 0; idx < tile_bins.size(); idx++) {
+        if (tile_bins[idx].empty()) continue;
+
+        int tile_min_x = static_cast<int>(idx % tiles_x) * TILE_SIZE;
+        int tile_min_y = static_cast<int>(idx / tiles_x) * TILE_SIZE;
+        int tile_max_x = std::min(tile_min_x + TILE_SIZE, bin_width) - 1;
+        int tile_max_y = std::min(tile_min_y + TILE_SIZE, bin_height) - 1;
+        int step = tile_cost[idx] > HEAVY_TILE_COST ? SUBTILE_SIZE : TILE_SIZE;
+
+        for (int y = tile_min_y; y <= tile_max_y; y += step) {
+            for (int x = tile_min_x; x <= tile_max_x; x += step) {
+                tile_tasks.push_back(TileTask{static_cast<uint32_t>(idx), x, y,
+                                              std::min(x + step - 1, tile_max_x), std::min(y + step - 1, tile_max_y)});
+            }
+        }
+    }
+}
+
+void Rasterizer::rasterize_depth_triangle(const TriangleSetup& setup, int rect_min_x, int rect_min_y, int rect_max_x, int rect_max_y, const DepthTarget& target, RasterStats& counters) {
+    if (setup.small) {
+        rasterize_small_depth_triangle(setup, rect_min_x, rect_min_y, rect_max_x, rect_max_y, target, counters);
+        return;
+    }
+    if (target.multisample) {
+        rasterize_depth_triangle_msaa(setup, rect_min_x, rect_min_y, rect_max_x, rect_max_y, target, counters);
+        return;
+    }
+
+    /* same block walk as the color path, but passing pixels only store their depth */
+    for_each_block(setup, rect_min_x, rect_min_y, rect_max_x, rect_max_y, target.framebuffer, DepthFunc::LESS,
+                   target.framebuffer, counters, [&](RasterBlock& block) {
+        bool block_written = false;
+        int count = block.x1 - block.x0 + 1;
+        float depth_row = block.depth_row;
+
+        for (int y = block.y0; y <= block.y1; y++, depth_row += setup.depth_dy) {
+            float* span_depth = target.depth + y * target.width + block.x0;
+
+            /* the depth test always applies, there is no shading to order it against */
+            uint32_t mask = span_mask(setup, block.w_row, depth_row, span_depth, count, block.fully_inside, true, DepthFunc::LESS);
+
+            if (mask != 0) {
+                block_written = true;
+                counters.depth_fragments += std::bitset<SPAN_WIDTH>(mask).count();
+                store_depth(simd_enabled, depth_row, setup.depth_dx, span_depth, mask);
+            }
+
+            for (int e = 0; e < 3; e++) {
+                block.w_row[e] += setup.edge_dy[e];
+            }
+        }
+        return block_written;
+    });
+}
+
+void Rasterizer::rasterize_depth_triangle_msaa(const TriangleSetup& setup, int rect_min_x, int rect_min_y, int rect_max_x, int rect_max_y, const DepthTarget& target, RasterStats& counters) {
+    /* same walk, coverage and sample depths as rasterize_triangle_msaa, so a later */
+    /* equal-depth color draw of this triangle passes on exactly the samples stored here */
+    for_each_block(setup, rect_min_x, rect_min_y, rect_max_x, rect_max_y, nullptr, DepthFunc::LESS, nullptr, counters, [&](RasterBlock& block) {
+        float depth_row = block.depth_row;
+        for (int y = block.y0; y <= block.y1; y++, depth_row += setup.depth_dy) {
+            for (int i = 0; i <= block.x1 - block.x0; i++) {
+                uint32_t coverage = sample_coverage(setup, block, i);
+                if (coverage == 0) continue;
+
+                float depth = depth_row + setup.depth_dx * static_cast<float>(i);
+                float* depths = target.depth + (static_cast<size_t>(y) * target.width + block.x0 + i) * MSAA_SAMPLES;
+                bool written = false;
+                for (int s = 0; s < MSAA_SAMPLES; s++) {
+                    float sample_z = depth + setup.sample_depth_offset[s];
+                    if ((coverage >> s & 1u) && sample_z < depths[s]) {
+                        depths[s] = sample_z;
+                        written = true;
+                    }
+                }
+                if (written) {
+                    counters.depth_fragments++;
+                }
+            }
+
+            for (int e = 0; e < 3; e++) {
+                block.w_row[e] += setup.edge_dy[e];
+            }
+        }
+        return false;
+    });
+}
+
+void Rasterizer::rasterize_small_depth_triangle(const TriangleSetup& setup, int rect_min_x, int rect_min_y, int rect_max_x, int rect_max_y, const DepthTarget& target, RasterStats& counters) {
+    bool written = false;
+
+    /* same footprint walk and depths as the color path's fast path, so a later */
+    /* equal-depth color draw of this triangle matches what is stored here */
+    uint32_t mask = setup.small_coverage;
+    for (int i = 0; mask != 0; i++, mask >>= 1) {
+        if (!(mask & 1u)) continue;
+
+        int dx = i % SMALL_TRIANGLE_SIZE;
+        int dy = i / SMALL_TRIANGLE_SIZE;
+        int x = setup.min_x + dx;
+        int y = setup.min_y + dy;
+        if (x < rect_min_x || x > rect_max_x || y < rect_min_y || y > rect_max_y) continue;
+
+        float depth = small_triangle_depth(setup, dx, dy);
+        float& stored = target.depth[y * target.width + x];
+        if (depth < stored) {
+            stored = depth;
+            counters.depth_fragments++;
+            written = true;
+        }
+    }
+
+    if (written && target.framebuffer != nullptr) {
+        int block_min_x = std::max(setup.min_x, rect_min_x) / BLOCK_SIZE;
+        int block_min_y = std::max(setup.min_y, rect_min_y) / BLOCK_SIZE;
+        int block_max_x = std::min(setup.max_x, rect_max_x) / BLOCK_SIZE;
+        int block_max_y = std::min(setup.max_y, rect_max_y) / BLOCK_SIZE;
+        for (int by = block_min_y; by <= block_max_y; by++) {
+            for (int bx = block_min_x; bx <= block_max_x; bx++) {
+                target.framebuffer->refresh_block_max_depth(bx, by);
+            }
+        }
+    }
+}
+
+void Rasterizer::draw_depth(const std::vector<Vec3>& positions, const DepthTarget& target) {
+    if (positions.size() < 3) {
+        return;
+    }
+
+    /* positions only: edge and depth setup, no attribute planes */
+    size_t num_triangles = positions.size() / 3;
+    begin_binning(target.width, target.height, target.framebuffer);
+    triangle_setups.reserve(num_triangles);
+    for (size_t i = 0; i < num_triangles; i++) {
+        TriangleSetup setup;
+        BarycentricPlanes bary;
+        if (setup_edges(positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2], target.width, target.height, target.multisample, setup, bary)) {
+            bin_setup(setup);
+        }
+    }
+    build_tile_tasks();
+
+    std::vector<RasterStats> thread_stats(thread_pool.get_num_threads());
+    thread_pool.parallel_for(tile_tasks.size(), 1, [&](size_t begin, size_t end, int thread_id) {
+        for (size_t t = begin; t < end; t++) {
+            const TileTask& task = tile_tasks[t];
+            for (uint32_t setup_index : tile_bins[task.tile]) {
+                rasterize_depth_triangle(triangle_setups[setup_index], task.min_x, task.min_y, task.max_x, task.max_y, target, thread_stats[thread_id]);
+            }
         }
+    });
+
+    for (const RasterStats& counters : thread_stats) {
+        stats.merge(counters);
     }
 }
 
+void Rasterizer::draw_depth_only(const std::vector<Vec3>& positions) {
+    if (framebuffer == nullptr) {
+        return;
+    }
+    /* multisampled, color draws test the samples, so those are what the depth must fill */
+    /* (per sample at the sample positions, without hierarchical Z like the color path) */
+    if (msaa_enabled) {
+        DepthTarget target = {sample_depth.data(), framebuffer->get_width(), framebuffer->get_height(), nullptr, true};
+        draw_depth(positions, target);
+        return;
+    }
+    DepthTarget target = {framebuffer->get_depth_buffer().data(), framebuffer->get_width(), framebuffer->get_height(), framebuffer, false};
+    draw_depth(positions, target);
+}
+
+void Rasterizer::draw_depth_only(const std::vector<Vec3>& positions, ShadowMap& shadow_map) {
+    DepthTarget target = {shadow_map.get_depth_buffer().data(), shadow_map.get_width(), shadow_map.get_height(), nullptr, false};
+    draw_depth(positions, target);
+}
+
 void Rasterizer::draw_triangles_parallel(const std::vector<RasterVertex>& vertices) {
-    if (framebuffer == nullptr || vertices.size() < 3) {
+    draw_triangles_parallel(vertices, FunctionShader{fragment_shader});
+}
+
+void Rasterizer::begin_visibility_pass() {
+    if (framebuffer == nullptr || msaa_enabled) {
         return;
     }
 
+    visibility_buffer.assign(framebuffer->get_width() * framebuffer->get_height(), VISIBILITY_EMPTY);
+    visibility_vertices.clear();
+    visibility_draw_ids.clear();
+    visibility_derivatives.clear();
+}
+
+void Rasterizer::draw_triangles_visibility(const std::vector<RasterVertex>& vertices, uint32_t draw_id, bool derivatives) {
+    if (framebuffer == nullptr || msaa_enabled || vertices.size() < 3) {
+        return;
+    }
+
+    /* keep the triangles: the resolve pass needs their attributes after all draws */
+    uint32_t first_triangle_id = static_cast<uint32_t>(visibility_draw_ids.size());
     size_t num_triangles = vertices.size() / 3;
-    std::atomic<size_t> triangle_index(0);
-
-    auto worker = [&]() {
-        while (true) {
-            size_t idx = triangle_index.fetch_add(1);
-            if (idx >= num_triangles) break;
-
-            size_t base = idx * 3;
-            const RasterVertex& v0 = vertices[base];
-            const RasterVertex& v1 = vertices[base + 1];
-            const RasterVertex& v2 = vertices[base + 2];
-
-            /* get screen positions */
-            Vec2 p0 = Vec2(v0.position.x, v0.position.y);
-            Vec2 p1 = Vec2(v1.position.x, v1.position.y);
-            Vec2 p2 = Vec2(v2.position.x, v2.position.y);
-
-            /* calculate signed area */
-            float area = edge_function(p0, p1, p2);
-
-            /* backface culling */
-            if (backface_culling && area < 0) continue;
-
-            /* degenerate triangle check */
-            if (std::abs(area) < 0.0001f) continue;
-
-            /* compute bounding box */
-            int min_x = static_cast<int>(std::floor(std::min({p0.x, p1.x, p2.x})));
-            int min_y = static_cast<int>(std::floor(std::min({p0.y, p1.y, p2.y})));
-            int max_x = static_cast<int>(std::ceil(std::max({p0.x, p1.x, p2.x})));
-            int max_y = static_cast<int>(std::ceil(std::max({p0.y, p1.y, p2.y})));
-
-            /* clip to screen */
-            min_x = std::max(min_x, 0);
-            min_y = std::max(min_y, 0);
-            max_x = std::min(max_x, framebuffer->get_width() - 1);
-            max_y = std::min(max_y, framebuffer->get_height() - 1);
-
-            float inv_area = 1.0f / area;
-
-            /* rasterize */
-            for (int y = min_y; y <= max_y; y++) {
-                for (int x = min_x; x <= max_x; x++) {
-                    Vec2 p = Vec2(x + 0.5f, y + 0.5f);
-
-                    float w0 = edge_function(p1, p2, p) * inv_area;
-                    float w1 = edge_function(p2, p0, p) * inv_area;
-                    float w2 = edge_function(p0, p1, p) * inv_area;
-
-                    if (w0 >= 0 && w1 >= 0 && w2 >= 0) {
-                        float depth = w0 * v0.position.z + w1 * v1.position.z + w2 * v2.position.z;
-
-                        Vec3 bary = Vec3(w0, w1, w2);
-                        Vec3 screen_pos = Vec3(x, y, depth);
-                        Fragment frag = interpolate_fragment(bary, v0, v1, v2, screen_pos);
-
-                        Color color;
-                        if (fragment_shader) {
-                            color = fragment_shader(frag);
-                        } else {
-                            color = frag.color;
-                        }
-
-                        write_pixel_safe(x, y, depth, color);
-                    }
+    visibility_vertices.insert(visibility_vertices.end(), vertices.begin(), vertices.begin() + num_triangles * 3);
+    visibility_draw_ids.insert(visibility_draw_ids.end(), num_triangles, draw_id);
+    if (visibility_derivatives.size() <= draw_id) {
+        visibility_derivatives.resize(draw_id + 1, 0);
+    }
+    visibility_derivatives[draw_id] = derivatives && quad_shading;
+
+    /* same tiled rasterization, but pixels only receive triangle id and depth */
+    visibility_pass = true;
+    /* ids only: no varying planes, the resolve interpolates from the stored vertices */
+    bin_triangles(visibility_vertices.data() + first_triangle_id * 3, num_triangles, first_triangle_id, Varyings::NONE);
+    rasterize_tiles(FunctionShader{fragment_shader});
+    visibility_pass = false;
+}
+
+void Rasterizer::resolve_visibility(const VisibilityShader& shader) {
+    if (framebuffer == nullptr || msaa_enabled || visibility_buffer.empty()) {
+        return;
+    }
+
+    int width = framebuffer->get_width();
+    int height = framebuffer->get_height();
+    std::vector<RasterStats> thread_stats(thread_pool.get_num_threads());
+
+    /* every pixel is shaded at most once, rows are independent tasks */
+    thread_pool.parallel_for(height, 1, [&](size_t begin, size_t end, int thread_id) {
+        for (int y = static_cast<int>(begin); y < static_cast<int>(end); y++) {
+            for (int x = 0; x < width; x++) {
+                uint32_t triangle_id = visibility_buffer[y * width + x];
+                if (triangle_id == VISIBILITY_EMPTY) continue;
+
+                const RasterVertex& v0 = visibility_vertices[triangle_id * 3];
+                const RasterVertex& v1 = visibility_vertices[triangle_id * 3 + 1];
+                const RasterVertex& v2 = visibility_vertices[triangle_id * 3 + 2];
+
+                /* reconstruct barycentrics at the pixel center */
+                Vec2 p0 = Vec2(v0.position.x, v0.position.y);
+                Vec2 p1 = Vec2(v1.position.x, v1.position.y);
+                Vec2 p2 = Vec2(v2.position.x, v2.position.y);
+                Vec2 p = Vec2(x + 0.5f, y + 0.5f);
+
+                float inv_area = 1.0f / edge_function(p0, p1, p2);
+                Vec3 bary = Vec3(
+                    edge_function(p1, p2, p),
+                    edge_function(p2, p0, p),
+                    edge_function(p0, p1, p)
+                ) * inv_area;
+
+                Vec3 screen_pos = Vec3(x, y, framebuffer->get_depth(x, y));
+                Fragment frag = interpolate_fragment(bary, v0, v1, v2, screen_pos);
+
+                /* neighbours may belong to other triangles, so the derivatives come from */
+                /* this one evaluated at x+1 and y+1, like helper lanes of a quad */
+                uint32_t draw_id = visibility_draw_ids[triangle_id];
+                if (visibility_derivatives[draw_id]) {
+                    Vec3 bary_dx = Vec3(p2.y - p1.y, p0.y - p2.y, p1.y - p0.y) * inv_area;
+                    Vec3 bary_dy = Vec3(p1.x - p2.x, p2.x - p0.x, p0.x - p1.x) * inv_area;
+                    Fragment frag_x = interpolate_fragment(bary + bary_dx, v0, v1, v2, screen_pos);
+                    Fragment frag_y = interpolate_fragment(bary + bary_dy, v0, v1, v2, screen_pos);
+                    frag.ddx = attribute_delta(frag, frag_x);
+                    frag.ddy = attribute_delta(frag, frag_y);
                 }
+
+                framebuffer->set_pixel(x, y, shader(draw_id, frag));
+                thread_stats[thread_id].fragments_shaded++;
             }
         }
+    });
+
+    for (const RasterStats& counters : thread_stats) {
+        stats.merge(counters);
+    }
+}
+
+uint32_t Rasterizer::pack_depth(float depth) {
+    /* the bit patterns of non-negative floats sort like their values */
+    depth = std::max(depth, 0.0f);
+    uint32_t bits;
+    std::memcpy(&bits, &depth, sizeof(bits));
+    return bits;
+}
+
+uint32_t Rasterizer::pack_color(Color color) {
+    auto channel = [](float value) {
+        return static_cast<uint32_t>(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
     };
+    return channel(color.r) | channel(color.g) << 8 | channel(color.b) << 16 | channel(color.a) << 24;
+}
+
+Color Rasterizer::unpack_color(uint32_t packed) {
+    return Color(packed & 0xFF, (packed >> 8) & 0xFF, (packed >> 16) & 0xFF, packed >> 24) / 255.0f;
+}
 
-    /* launch worker threads */
-    std::vector<std::thread> threads;
-    for (int i = 0; i < num_threads; i++) {
-        threads.emplace_back(worker);
+void Rasterizer::begin_packed_pass() {
+    if (framebuffer == nullptr || msaa_enabled) {
+        return;
     }
 
-    /* wait for all threads to complete */
-    for (auto& t : threads) {
-        t.join();
+    size_t size = static_cast<size_t>(framebuffer->get_width()) * framebuffer->get_height();
+    if (size != packed_size) {
+        packed_buffer.reset(new std::atomic<uint64_t>[size]);
+        packed_size = size;
     }
+
+    /* start from the current depth with a zero color: a fragment must be strictly */
+    /* nearer to replace it, like the LESS depth test */
+    const float* depth_buffer = framebuffer->get_depth_buffer().data();
+    thread_pool.parallel_for(size, framebuffer->get_width(), [&](size_t begin, size_t end, int) {
+        for (size_t i = begin; i < end; i++) {
+            packed_buffer[i].store(static_cast<uint64_t>(pack_depth(depth_buffer[i])) << 32, std::memory_order_relaxed);
+        }
+    });
+}
+
+void Rasterizer::resolve_packed() {
+    if (framebuffer == nullptr || msaa_enabled || !packed_buffer) {
+        return;
+    }
+
+    int width = framebuffer->get_width();
+    std::vector<Color>& color_buffer = framebuffer->get_color_buffer();
+    std::vector<float>& depth_buffer = framebuffer->get_depth_buffer();
+
+    for_each_depth_block_row([&](int y0, int y1) {
+        for (int i = y0 * width; i < y1 * width; i++) {
+            uint64_t word = packed_buffer[i].load(std::memory_order_relaxed);
+            uint32_t depth_bits = static_cast<uint32_t>(word >> 32);
+
+            /* untouched pixels still hold the depth they started with */
+            if (depth_bits >= pack_depth(depth_buffer[i])) continue;
+
+            std::memcpy(&depth_buffer[i], &depth_bits, sizeof(depth_bits));
+            color_buffer[i] = unpack_color(static_cast<uint32_t>(word));
+        }
+    });
+}
+
+void Rasterizer::begin_oit_pass() {
+    if (framebuffer == nullptr) {
+        return;
+    }
+
+    int width = framebuffer->get_width();
+    size_t size = static_cast<size_t>(width) * framebuffer->get_height();
+    oit_accumulation.assign(size, Color(0.0f));
+    oit_revealage.assign(size, 1.0f);
+
+    /* multisampled, the opaque depth is only in the samples while the OIT draws test */
+    /* single pixels: give them the nearest sample depth, the one resolve_msaa keeps */
+    if (msaa_enabled) {
+        std::vector<float>& depth_buffer = framebuffer->get_depth_buffer();
+        for_each_depth_block_row([&](int y0, int y1) {
+            for (int i = y0 * width; i < y1 * width; i++) {
+                const float* depths = &sample_depth[static_cast<size_t>(i) * MSAA_SAMPLES];
+                depth_buffer[i] = *std::min_element(depths, depths + MSAA_SAMPLES);
+            }
+        });
+    }
+}
+
+void Rasterizer::accumulate_oit(int x, int y, Color color, float depth) {
+    /* McGuire and Bavoil's depth weight: nearer and more opaque surfaces dominate */
+    /* the average, clamped so far layers still count and near ones cannot overflow */
+    float alpha = std::min(std::max(color.a, 0.0f), 1.0f);
+    float distance = 1.0f - std::min(std::max(depth, 0.0f), 1.0f);
+    float weight = alpha * std::min(std::max(3e3f * distance * distance * distance, 1e-2f), 3e3f);
+
+    int index = y * framebuffer->get_width() + x;
+    oit_accumulation[index] += Color(Vec3(color) * alpha, alpha) * weight;
+    oit_revealage[index] *= 1.0f - alpha;
+}
+
+void Rasterizer::composite_oit() {
+    if (framebuffer == nullptr || oit_accumulation.empty()) {
+        return;
+    }
+
+    int width = framebuffer->get_width();
+    int height = framebuffer->get_height();
+    std::vector<Color>& color_buffer = framebuffer->get_color_buffer();
+
+    /* pixels are independent, rows are tasks; multisampled, the layer is blended over */
+    /* every sample so the resolve keeps it */
+    int targets = msaa_enabled ? MSAA_SAMPLES : 1;
+    thread_pool.parallel_for(height, 1, [&](size_t begin, size_t end, int) {
+        for (size_t i = begin * width; i < end * width; i++) {
+            float revealage = oit_revealage[i];
+            if (revealage >= 1.0f) continue;
+
+            /* weighted average color covers 1 - revealage of the background */
+            Color accumulated = oit_accumulation[i];
+            Vec3 average = Vec3(accumulated) / std::max(accumulated.a, 1e-5f);
+            Color* dst = msaa_enabled ? &sample_color[i * MSAA_SAMPLES] : &color_buffer[i];
+            for (int s = 0; s < targets; s++) {
+                dst[s] = Color(average * (1.0f - revealage) + Vec3(dst[s]) * revealage, 1.0f - (1.0f - dst[s].a) * revealage);
+            }
+        }
+    });
+}
+
+void Rasterizer::begin_sort_last() {
+    int width = framebuffer->get_width();
+    int height = framebuffer->get_height();
+    size_t threads = static_cast<size_t>(thread_pool.get_num_threads());
+
+    /* targets are kept across frames, rebuilt when the size or thread count changes */
+    if (thread_targets.size() != threads || thread_targets[0]->get_width() != width || thread_targets[0]->get_height() != height) {
+        thread_targets.clear();
+        for (size_t i = 0; i < threads; i++) {
+            thread_targets.emplace_back(new FrameBuffer(width, height));
+        }
+        thread_draw_ids.assign(threads, std::vector<uint32_t>(static_cast<size_t>(width) * height));
+    }
+    thread_target_used.assign(threads, 0);
+}
+
+void Rasterizer::composite_sort_last() {
+    int width = framebuffer->get_width();
+
+    std::vector<size_t> used;
+    for (size_t i = 0; i < thread_targets.size(); i++) {
+        if (thread_target_used[i]) {
+            used.push_back(i);
+        }
+    }
+
+    std::vector<Color>& color_buffer = framebuffer->get_color_buffer();
+    std::vector<float>& depth_buffer = framebuffer->get_depth_buffer();
+
+    for_each_depth_block_row([&](int y0, int y1) {
+        for (int i = y0 * width; i < y1 * width; i++) {
+            /* targets started from this depth, so only pixels they wrote can be nearer; */
+            /* equal depths go to the lower draw id, as forward submission would leave them */
+            uint32_t nearest_id = SORT_LAST_EMPTY;
+            for (size_t t : used) {
+                float depth = thread_targets[t]->get_depth_buffer()[i];
+                uint32_t draw_id = thread_draw_ids[t][i];
+                if (depth < depth_buffer[i] || (depth == depth_buffer[i] && draw_id < nearest_id)) {
+                    depth_buffer[i] = depth;
+                    color_buffer[i] = thread_targets[t]->get_color_buffer()[i];
+                    nearest_id = draw_id;
+                }
+            }
+        }
+    });
 }
@@ -153,6 +153,10 @@ float ShadowMap::sample_shadow_pcf(Vec3 world_pos, int kernel_size) const {
     return (samples > 0) ? shadow / samples : 0.0f;
 }
 
+std::vector<float>& ShadowMap::get_depth_buffer() {
+    return depth_buffer;
+}
+
 int ShadowMap::get_width() const {
     return width;
 }
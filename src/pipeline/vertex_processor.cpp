@@ -1,4 +1,102 @@
 #include "pipeline/vertex_processor.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define VERTEX_AVX2_KERNEL 1
+#endif
+
+/* structure-of-arrays staging of one batch: component arrays, one lane per vertex */
+struct StagedVertices {
+    float position[3][VertexProcessor::BATCH_SIZE];
+    float normal[3][VertexProcessor::BATCH_SIZE];
+};
+
+struct TransformedVertices {
+    float clip[4][VertexProcessor::BATCH_SIZE];
+    float world[3][VertexProcessor::BATCH_SIZE];
+    float normal[3][VertexProcessor::BATCH_SIZE];
+};
+
+/* column-major matrices as in glm: element (row r, column c) at m[c * rows + r] */
+/* sums are grouped like glm's matrix-vector products */
+static void transform_batch_scalar(const float* mvp, const float* model, const float* normal_matrix,
+                                   const StagedVertices& in, TransformedVertices& out) {
+    for (int i = 0; i < VertexProcessor::BATCH_SIZE; i++) {
+        float x = in.position[0][i];
+        float y = in.position[1][i];
+        float z = in.position[2][i];
+        for (int r = 0; r < 4; r++) {
+            out.clip[r][i] = (mvp[r] * x + mvp[4 + r] * y) + (mvp[8 + r] * z + mvp[12 + r]);
+        }
+        for (int r = 0; r < 3; r++) {
+            out.world[r][i] = (model[r] * x + model[4 + r] * y) + (model[8 + r] * z + model[12 + r]);
+        }
+
+        float n[3];
+        for (int r = 0; r < 3; r++) {
+            n[r] = normal_matrix[r] * in.normal[0][i] + normal_matrix[3 + r] * in.normal[1][i] + normal_matrix[6 + r] * in.normal[2][i];
+        }
+        float inv_length = 1.0f / std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        for (int r = 0; r < 3; r++) {
+            out.normal[r][i] = n[r] * inv_length;
+        }
+    }
+}
+
+#ifdef VERTEX_AVX2_KERNEL
+/* row r of a column-major affine matrix applied to 8 points: (m0 x + m1 y) + (m2 z + m3) */
+/* (a function, not a lambda: lambdas do not inherit the target attribute) */
+__attribute__((target("avx2")))
+static inline __m256 affine_row_avx2(const float* m, int rows, int r, __m256 x, __m256 y, __m256 z) {
+    __m256 xy = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[r]), x), _mm256_mul_ps(_mm256_set1_ps(m[rows + r]), y));
+    __m256 zw = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[2 * rows + r]), z), _mm256_set1_ps(m[3 * rows + r]));
+    return _mm256_add_ps(xy, zw);
+}
+
+/* AVX2 batch transform: one register per component, 8 vertices per instruction */
+__attribute__((target("avx2")))
+static void transform_batch_avx2(const float* mvp, const float* model, const float* normal_matrix,
+                                 const StagedVertices& in, TransformedVertices& out) {
+    __m256 x = _mm256_loadu_ps(in.position[0]);
+    __m256 y = _mm256_loadu_ps(in.position[1]);
+    __m256 z = _mm256_loadu_ps(in.position[2]);
+
+    for (int r = 0; r < 4; r++) {
+        _mm256_storeu_ps(out.clip[r], affine_row_avx2(mvp, 4, r, x, y, z));
+    }
+    for (int r = 0; r < 3; r++) {
+        _mm256_storeu_ps(out.world[r], affine_row_avx2(model, 4, r, x, y, z));
+    }
+
+    __m256 nx = _mm256_loadu_ps(in.normal[0]);
+    __m256 ny = _mm256_loadu_ps(in.normal[1]);
+    __m256 nz = _mm256_loadu_ps(in.normal[2]);
+    __m256 n[3];
+    for (int r = 0; r < 3; r++) {
+        n[r] = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(normal_matrix[r]), nx),
+                                           _mm256_mul_ps(_mm256_set1_ps(normal_matrix[3 + r]), ny)),
+                             _mm256_mul_ps(_mm256_set1_ps(normal_matrix[6 + r]), nz));
+    }
+
+    /* exact square root and divide, not the rsqrt estimate, to match the scalar path */
+    __m256 length_squared = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(n[0], n[0]), _mm256_mul_ps(n[1], n[1])), _mm256_mul_ps(n[2], n[2]));
+    __m256 inv_length = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(length_squared));
+    for (int r = 0; r < 3; r++) {
+        _mm256_storeu_ps(out.normal[r], _mm256_mul_ps(n[r], inv_length));
+    }
+}
+#endif
+
+/* runtime CPU feature check for the AVX2 kernel */
+static bool cpu_supports_avx2() {
+#ifdef VERTEX_AVX2_KERNEL
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
 
 VertexProcessor::VertexProcessor() {
     uniforms.model_matrix = Mat4(1.0f);
@@ -8,6 +106,15 @@ VertexProcessor::VertexProcessor() {
     uniforms.normal_matrix = Mat3(1.0f);
     viewport_width = 800;
     viewport_height = 600;
+    simd_enabled = cpu_supports_avx2();
+}
+
+void VertexProcessor::set_simd_enabled(bool enabled) {
+    simd_enabled = enabled && cpu_supports_avx2();
+}
+
+bool VertexProcessor::is_simd_enabled() const {
+    return simd_enabled;
 }
 
 void VertexProcessor::set_model_matrix(Mat4 model) {
@@ -92,3 +199,45 @@ VertexOutput VertexProcessor::process_vertex(const VertexInput& input) {
 
     return output;
 }
+
+void VertexProcessor::process_vertices(const VertexInput* inputs, size_t count, ClipVertex* outputs) {
+    const float* mvp = &uniforms.mvp_matrix[0][0];
+    const float* model = &uniforms.model_matrix[0][0];
+    const float* normal_matrix = &uniforms.normal_matrix[0][0];
+
+    StagedVertices in;
+    TransformedVertices out;
+
+    for (size_t base = 0; base < count; base += BATCH_SIZE) {
+        int n = static_cast<int>(std::min<size_t>(BATCH_SIZE, count - base));
+
+        /* AoS to SoA; lanes past the end get a harmless unit normal */
+        for (int i = 0; i < BATCH_SIZE; i++) {
+            const VertexInput* input = i < n ? &inputs[base + i] : nullptr;
+            for (int c = 0; c < 3; c++) {
+                in.position[c][i] = input ? input->position[c] : 0.0f;
+                in.normal[c][i] = input ? input->normal[c] : (c == 2 ? 1.0f : 0.0f);
+            }
+        }
+
+#ifdef VERTEX_AVX2_KERNEL
+        if (simd_enabled) {
+            transform_batch_avx2(mvp, model, normal_matrix, in, out);
+        } else {
+            transform_batch_scalar(mvp, model, normal_matrix, in, out);
+        }
+#else
+        transform_batch_scalar(mvp, model, normal_matrix, in, out);
+#endif
+
+        /* SoA back to the clipper's vertices, attributes without a transform pass through */
+        for (int i = 0; i < n; i++) {
+            ClipVertex& output = outputs[base + i];
+            output.clip_pos = Vec4(out.clip[0][i], out.clip[1][i], out.clip[2][i], out.clip[3][i]);
+            output.world_pos = Vec3(out.world[0][i], out.world[1][i], out.world[2][i]);
+            output.normal = Vec3(out.normal[0][i], out.normal[1][i], out.normal[2][i]);
+            output.tex_coord = inputs[base + i].tex_coord;
+            output.color = inputs[base + i].color;
+        }
+    }
+}
@@ -36,12 +36,6 @@ float Texture::wrap_coord(float coord) const {
     return coord;
 }
 
-Color Texture::get_pixel(int x, int y) const {
-    x = std::clamp(x, 0, width - 1);
-    y = std::clamp(y, 0, height - 1);
-    return pixels[y * width + x];
-}
-
 bool Texture::load(const std::string& filepath) {
     /* determine file type from extension */
     size_t dot_pos = filepath.find_last_of('.');
@@ -90,6 +84,7 @@ bool Texture::load(const std::string& filepath) {
 
         channels = bits_per_pixel / 8;
         pixels.resize(width * height);
+        mips.clear();
 
         /* read pixel data */
         for (int y = 0; y < height; ++y) {
@@ -142,6 +137,7 @@ bool Texture::load(const std::string& filepath) {
 
         channels = 3;
         pixels.resize(width * height);
+        mips.clear();
 
         /* read pixel data */
         for (int y = 0; y < height; ++y) {
@@ -175,6 +171,7 @@ bool Texture::load(const std::string& filepath) {
         height = h;
         channels = c;
         pixels.resize(width * height);
+        mips.clear();
 
         for (int y = 0; y < height; ++y) {
             for (int x = 0; x < width; ++x) {
@@ -207,19 +204,22 @@ bool Texture::create(int i_width, int i_height, const std::vector<Color>& data)
     width = i_width;
     height = i_height;
     pixels = data;
+    mips.clear();
     return true;
 }
 
 void Texture::create_solid(int i_width, int i_height, Color color) {
     width = i_width;
     height = i_height;
-    pixels.resize(width * height, color);
+    pixels.assign(width * height, color);
+    mips.clear();
 }
 
 void Texture::create_checkerboard(int i_width, int i_height, int squares, Color color1, Color color2) {
     width = i_width;
     height = i_height;
     pixels.resize(width * height);
+    mips.clear();
 
     int square_size_x = width / squares;
     int square_size_y = height / squares;
@@ -242,7 +242,50 @@ Color Texture::sample(float u, float v) const {
     if (!is_valid()) {
         return Color(1.0f, 0.0f, 1.0f, 1.0f); /* magenta for missing texture */
     }
+    return sample_level(pixels.data(), width, height, u, v);
+}
+
+Color Texture::sample(Vec2 uv, Vec2 duv_dx, Vec2 duv_dy) const {
+    if (!is_valid()) {
+        return Color(1.0f, 0.0f, 1.0f, 1.0f);
+    }
+    if (mips.empty()) {
+        return sample_level(pixels.data(), width, height, uv.x, uv.y);
+    }
 
+    /* level of detail: log2 of the longer pixel footprint, in level-0 texels */
+    Vec2 size = Vec2(static_cast<float>(width), static_cast<float>(height));
+    Vec2 footprint_x = duv_dx * size;
+    Vec2 footprint_y = duv_dy * size;
+    float rho_squared = std::max(glm::dot(footprint_x, footprint_x), glm::dot(footprint_y, footprint_y));
+    if (!(rho_squared > 1.0f)) {
+        return sample_level(pixels.data(), width, height, uv.x, uv.y);   /* magnified, or NaN */
+    }
+    float lod = std::min(0.5f * std::log2(rho_squared), static_cast<float>(mips.size()));
+
+    auto level_sample = [&](int level) {
+        if (level == 0) {
+            return sample_level(pixels.data(), width, height, uv.x, uv.y);
+        }
+        const MipLevel& mip = mips[level - 1];
+        return sample_level(mip.pixels.data(), mip.width, mip.height, uv.x, uv.y);
+    };
+
+    if (filter_mode == FilterMode::NEAREST) {
+        return level_sample(static_cast<int>(lod + 0.5f));
+    }
+
+    /* trilinear: blend the two levels around the lod */
+    int level = static_cast<int>(lod);
+    float blend = lod - static_cast<float>(level);
+    Color near_color = level_sample(level);
+    if (blend <= 0.0f || level >= static_cast<int>(mips.size())) {
+        return near_color;
+    }
+    return near_color * (1.0f - blend) + level_sample(level + 1) * blend;
+}
+
+Color Texture::sample_level(const Color* level_pixels, int level_width, int level_height, float u, float v) const {
     /* wrap coordinates */
     u = wrap_coord(u);
     v = wrap_coord(v);
@@ -251,13 +294,19 @@ Color Texture::sample(float u, float v) const {
     v = 1.0f - v;
 
     /* convert to pixel coordinates */
-    float px = u * (width - 1);
-    float py = v * (height - 1);
+    float px = u * (level_width - 1);
+    float py = v * (level_height - 1);
+
+    auto texel = [&](int x, int y) {
+        x = std::clamp(x, 0, level_width - 1);
+        y = std::clamp(y, 0, level_height - 1);
+        return level_pixels[y * level_width + x];
+    };
 
     if (filter_mode == FilterMode::NEAREST) {
         int x = static_cast<int>(std::round(px));
         int y = static_cast<int>(std::round(py));
-        return get_pixel(x, y);
+        return texel(x, y);
     }
     else { /* BILINEAR */
         int x0 = static_cast<int>(std::floor(px));
@@ -268,10 +317,10 @@ Color Texture::sample(float u, float v) const {
         float fx = px - x0;
         float fy = py - y0;
 
-        Color c00 = get_pixel(x0, y0);
-        Color c10 = get_pixel(x1, y0);
-        Color c01 = get_pixel(x0, y1);
-        Color c11 = get_pixel(x1, y1);
+        Color c00 = texel(x0, y0);
+        Color c10 = texel(x1, y0);
+        Color c01 = texel(x0, y1);
+        Color c11 = texel(x1, y1);
 
         /* bilinear interpolation */
         Color c0 = c00 * (1.0f - fx) + c10 * fx;
@@ -280,6 +329,52 @@ Color Texture::sample(float u, float v) const {
     }
 }
 
+void Texture::generate_mipmaps() {
+    mips.clear();
+    if (!is_valid()) {
+        return;
+    }
+
+    const Color* source = pixels.data();
+    int source_width = width;
+    int source_height = height;
+
+    /* each level averages 2x2 texels of the one above; on an odd axis the last */
+    /* texel folds its neighbour in too, a 3-tap average, so no texel is dropped */
+    while (source_width > 1 || source_height > 1) {
+        MipLevel level;
+        level.width = std::max(source_width / 2, 1);
+        level.height = std::max(source_height / 2, 1);
+        level.pixels.resize(static_cast<size_t>(level.width) * level.height);
+
+        for (int y = 0; y < level.height; y++) {
+            int sy0 = std::min(y * 2, source_height - 1);
+            int sy1 = (y == level.height - 1) ? source_height - 1 : y * 2 + 1;
+            for (int x = 0; x < level.width; x++) {
+                int sx0 = std::min(x * 2, source_width - 1);
+                int sx1 = (x == level.width - 1) ? source_width - 1 : x * 2 + 1;
+
+                Color sum(0.0f);
+                for (int sy = sy0; sy <= sy1; sy++) {
+                    for (int sx = sx0; sx <= sx1; sx++) {
+                        sum += source[sy * source_width + sx];
+                    }
+                }
+                level.pixels[y * level.width + x] = sum / static_cast<float>((sy1 - sy0 + 1) * (sx1 - sx0 + 1));
+            }
+        }
+
+        mips.push_back(std::move(level));
+        source = mips.back().pixels.data();
+        source_width = mips.back().width;
+        source_height = mips.back().height;
+    }
+}
+
+int Texture::get_mip_levels() const {
+    return 1 + static_cast<int>(mips.size());
+}
+
 void Texture::set_filter_mode(FilterMode mode) {
     filter_mode = mode;
 }
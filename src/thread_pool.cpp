@@ -0,0 +1,226 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include <chrono>
+
+/* set while a thread is executing pool work, to run nested jobs inline */
+static thread_local bool inside_pool_job = false;
+
+/* pool thread id of the job a thread is executing, handed on to nested jobs */
+static thread_local int current_thread_id = 0;
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+ThreadPool::ThreadPool(int threads) :
+    num_threads(1),
+    job_seconds(0.0),
+    job_body(nullptr),
+    job_count(0),
+    job_grain(1),
+    workers_busy(0),
+    job_generation(0),
+    stopping(false)
+{
+    start(threads);
+}
+
+ThreadPool::~ThreadPool() {
+    stop();
+}
+
+void ThreadPool::start(int threads) {
+    if (threads <= 0) {
+        threads = static_cast<int>(std::thread::hardware_concurrency());
+        if (threads == 0) threads = 4;
+    }
+    num_threads = threads;
+    stopping = false;
+
+    queues.reset(new WorkQueue[num_threads]);
+    for (int i = 0; i < num_threads; i++) {
+        queues[i].begin = 0;
+        queues[i].end = 0;
+    }
+    thread_stats.reset(new PaddedStats[num_threads]);
+    job_seconds = 0.0;
+
+    /* new workers must not mistake the last finished job for a fresh one */
+    unsigned long generation;
+    {
+        std::lock_guard<std::mutex> lock(job_mutex);
+        generation = job_generation;
+    }
+
+    /* the caller is thread 0, so only n - 1 workers are spawned */
+    for (int i = 1; i < num_threads; i++) {
+        workers.emplace_back(&ThreadPool::worker_loop, this, i, generation);
+    }
+}
+
+void ThreadPool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(job_mutex);
+        stopping = true;
+    }
+    job_ready.notify_all();
+
+    for (auto& t : workers) {
+        t.join();
+    }
+    workers.clear();
+}
+
+void ThreadPool::resize(int threads) {
+    stop();
+    start(threads);
+}
+
+int ThreadPool::get_num_threads() const {
+    return num_threads;
+}
+
+bool ThreadPool::pop_chunk(int thread_id, size_t& begin, size_t& end) {
+    WorkQueue& queue = queues[thread_id];
+    std::lock_guard<std::mutex> lock(queue.lock);
+    if (queue.begin >= queue.end) {
+        return false;
+    }
+    begin = queue.begin;
+    end = std::min(begin + job_grain, queue.end);
+    queue.begin = end;
+    return true;
+}
+
+bool ThreadPool::steal_chunks(int thread_id) {
+    /* visit victims starting at the next thread so thieves spread out */
+    for (int i = 1; i < num_threads; i++) {
+        WorkQueue& victim = queues[(thread_id + i) % num_threads];
+        size_t begin, end;
+        {
+            std::lock_guard<std::mutex> lock(victim.lock);
+            if (victim.begin >= victim.end) {
+                continue;
+            }
+            /* leave the victim its front half, rounded so at least one task moves */
+            size_t remaining = victim.end - victim.begin;
+            begin = victim.end - (remaining + 1) / 2;
+            end = victim.end;
+            victim.end = begin;
+        }
+
+        WorkQueue& own = queues[thread_id];
+        std::lock_guard<std::mutex> lock(own.lock);
+        own.begin = begin;
+        own.end = end;
+        thread_stats[thread_id].stats.tasks_stolen += end - begin;
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::run_chunks(int thread_id) {
+    ThreadStats& stats = thread_stats[thread_id].stats;
+    inside_pool_job = true;
+    current_thread_id = thread_id;
+    while (true) {
+        size_t begin, end;
+        if (!pop_chunk(thread_id, begin, end)) {
+            if (!steal_chunks(thread_id)) break;
+            continue;
+        }
+        auto chunk_start = std::chrono::steady_clock::now();
+        (*job_body)(begin, end, thread_id);
+        stats.busy_seconds += seconds_since(chunk_start);
+        stats.tasks_run += end - begin;
+    }
+    inside_pool_job = false;
+    current_thread_id = 0;
+}
+
+void ThreadPool::worker_loop(int thread_id, unsigned long seen_generation) {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(job_mutex);
+            job_ready.wait(lock, [&]() { return stopping || job_generation != seen_generation; });
+            if (stopping) return;
+            seen_generation = job_generation;
+        }
+
+        run_chunks(thread_id);
+
+        {
+            std::lock_guard<std::mutex> lock(job_mutex);
+            workers_busy--;
+        }
+        job_done.notify_one();
+    }
+}
+
+void ThreadPool::parallel_for(size_t count, size_t grain, const std::function<void(size_t, size_t, int)>& body) {
+    if (count == 0) {
+        return;
+    }
+    grain = std::max<size_t>(grain, 1);
+
+    /* nested or trivially small jobs run on the calling thread */
+    if (inside_pool_job || workers.empty() || count <= grain) {
+        bool was_inside = inside_pool_job;
+        inside_pool_job = true;
+        auto inline_start = std::chrono::steady_clock::now();
+        body(0, count, was_inside ? current_thread_id : 0);
+        inside_pool_job = was_inside;
+
+        /* nested work is already timed by the enclosing job */
+        if (!was_inside) {
+            double elapsed = seconds_since(inline_start);
+            thread_stats[0].stats.busy_seconds += elapsed;
+            thread_stats[0].stats.tasks_run += count;
+            job_seconds += elapsed;
+        }
+        return;
+    }
+
+    auto job_start = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(job_mutex);
+        job_body = &body;
+        job_count = count;
+        job_grain = grain;
+
+        /* contiguous ranges keep neighbouring tasks on one thread until stealing starts */
+        for (int i = 0; i < num_threads; i++) {
+            std::lock_guard<std::mutex> queue_lock(queues[i].lock);
+            queues[i].begin = count * i / num_threads;
+            queues[i].end = count * (i + 1) / num_threads;
+        }
+
+        workers_busy = static_cast<int>(workers.size());
+        job_generation++;
+    }
+    job_ready.notify_all();
+
+    /* the caller works too, then waits for every worker to leave the job */
+    run_chunks(0);
+
+    std::unique_lock<std::mutex> lock(job_mutex);
+    job_done.wait(lock, [&]() { return workers_busy == 0; });
+    job_body = nullptr;
+    job_seconds += seconds_since(job_start);
+}
+
+std::vector<ThreadStats> ThreadPool::get_thread_stats() const {
+    std::vector<ThreadStats> report(num_threads);
+    for (int i = 0; i < num_threads; i++) {
+        report[i] = thread_stats[i].stats;
+        report[i].idle_seconds = std::max(job_seconds - report[i].busy_seconds, 0.0);
+    }
+    return report;
+}
+
+void ThreadPool::reset_thread_stats() {
+    for (int i = 0; i < num_threads; i++) {
+        thread_stats[i].stats = ThreadStats();
+    }
+    job_seconds = 0.0;
+}
@@ -0,0 +1,115 @@
+#include "pipeline/primitive_assembler.h"
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+static const int WIDTH = 800;
+static const int HEIGHT = 600;
+
+static int failures = 0;
+
+static void check(bool condition, const char* what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+/* wavy n x n quad grid, wider than the view so the triangles at its sides are clipped */
+static Mesh make_grid(int n) {
+    Mesh mesh;
+    for (int j = 0; j <= n; j++) {
+        for (int i = 0; i <= n; i++) {
+            float x = 8.0f * i / n - 4.0f;
+            float z = 8.0f * j / n - 4.0f;
+            VertexInput v;
+            v.position = Vec3(x, 0.3f * std::sin(3.0f * x) * std::cos(2.0f * z), z);
+            v.normal = Vec3(0.0f, 1.0f, 0.0f);
+            v.tex_coord = Vec2(static_cast<float>(i) / n, static_cast<float>(j) / n);
+            v.color = Color(1.0f);
+            mesh.vertices.push_back(v);
+        }
+    }
+    for (int j = 0; j < n; j++) {
+        for (int i = 0; i < n; i++) {
+            unsigned int a = j * (n + 1) + i;
+            unsigned int b = a + 1;
+            unsigned int c = a + n + 1;
+            unsigned int d = c + 1;
+            mesh.indices.insert(mesh.indices.end(), {a, c, b, b, c, d});
+        }
+    }
+    return mesh;
+}
+
+static VertexProcessor make_vertex_processor() {
+    VertexProcessor vertex_processor;
+    vertex_processor.set_viewport(WIDTH, HEIGHT);
+    vertex_processor.set_view_matrix(MatrixUtils::lookAt(Vec3(0.0f, 3.0f, 5.0f), Vec3(0.0f), Vec3(0.0f, 1.0f, 0.0f)));
+    vertex_processor.set_projection_matrix(MatrixUtils::perspective(glm::radians(60.0f), static_cast<float>(WIDTH) / HEIGHT, 0.1f, 100.0f));
+    return vertex_processor;
+}
+
+/* indexed assembly keeps every triangle of the per-triangle path, in the same order */
+/* (the batch transform rounds differently from process_vertex, so positions are close, not equal) */
+static void test_indexed_matches_per_triangle() {
+    Mesh mesh = make_grid(64);
+    VertexProcessor vertex_processor = make_vertex_processor();
+    Clipper clipper;
+    PrimitiveAssembler assembler;
+
+    std::vector<RasterVertex> per_triangle;
+    for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3) {
+        assembler.assemble_triangle(mesh.vertices[mesh.indices[t]], mesh.vertices[mesh.indices[t + 1]],
+                                    mesh.vertices[mesh.indices[t + 2]], vertex_processor, clipper, WIDTH, HEIGHT, per_triangle);
+    }
+    std::vector<RasterVertex> indexed;
+    assembler.assemble_indexed(mesh, vertex_processor, clipper, WIDTH, HEIGHT, indexed);
+
+    check(!indexed.empty() && indexed.size() < mesh.indices.size(), "grid is not partly clipped away");
+    check(indexed.size() == per_triangle.size(), "indexed and per-triangle vertex counts differ");
+    bool close = indexed.size() == per_triangle.size();
+    for (size_t i = 0; close && i < indexed.size(); i++) {
+        close = glm::length(indexed[i].position - per_triangle[i].position) < 1e-2f;
+    }
+    check(close, "indexed positions differ from the per-triangle ones");
+}
+
+/* the parallel front end neither drops nor reorders triangles: any pool gives the serial output */
+static void test_pool_matches_serial() {
+    Mesh mesh = make_grid(128);
+    VertexProcessor vertex_processor = make_vertex_processor();
+    Clipper clipper;
+    PrimitiveAssembler assembler;
+
+    std::vector<RasterVertex> serial;
+    assembler.assemble_indexed(mesh, vertex_processor, clipper, WIDTH, HEIGHT, serial);
+    check(mesh.triangle_count() > 4 * PrimitiveAssembler::TRIANGLE_CHUNK, "grid fits in too few assembly chunks");
+
+    bool identical = true;
+    for (int threads = 1; threads <= 4; threads++) {
+        ThreadPool pool(threads);
+        assembler.set_thread_pool(&pool);
+        for (int run = 0; run < 10; run++) {
+            std::vector<RasterVertex> pooled;
+            assembler.assemble_indexed(mesh, vertex_processor, clipper, WIDTH, HEIGHT, pooled);
+            identical = identical && pooled.size() == serial.size()
+                     && std::memcmp(pooled.data(), serial.data(), serial.size() * sizeof(RasterVertex)) == 0;
+        }
+        assembler.set_thread_pool(nullptr);
+    }
+    check(identical, "pooled assembly differs from the serial output");
+}
+
+int main() {
+    test_indexed_matches_per_triangle();
+    test_pool_matches_serial();
+
+    if (failures > 0) {
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "assembler_test passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,102 @@
+#include "pipeline/clipper.h"
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <random>
+
+/* every heap allocation in the process is counted */
+static size_t allocations = 0;
+
+void* operator new(std::size_t size) {
+    allocations++;
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+static int failures = 0;
+
+static void check(bool condition, const char* what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+static ClipVertex make_vertex(float x, float y, float z, float w) {
+    ClipVertex v;
+    v.clip_pos = Vec4(x, y, z, w);
+    v.world_pos = Vec3(x, y, z);
+    v.normal = Vec3(0.0f, 0.0f, 1.0f);
+    v.tex_coord = Vec2(x, y);
+    v.color = Color(1.0f);
+    return v;
+}
+
+/* clipping a triangle that crosses every plane must not touch the heap */
+static void test_no_allocations() {
+    Clipper clipper;
+    ClipVertex v0 = make_vertex(-3.0f, -3.0f, -2.0f, 1.0f);
+    ClipVertex v1 = make_vertex(3.0f, -3.0f, 0.5f, 1.0f);
+    ClipVertex v2 = make_vertex(0.0f, 4.0f, 2.0f, 1.0f);
+    ClipVertex clipped[Clipper::MAX_CLIPPED_VERTICES];
+
+    size_t before = allocations;
+    int total = 0;
+    for (int i = 0; i < 1000; i++) {
+        total += clipper.clip_triangle(v0, v1, v2, clipped);
+    }
+    check(allocations == before, "clip_triangle allocated");
+    check(total > 0, "triangle crossing the frustum was clipped away");
+}
+
+/* triangles with vertices on and around frustum corners stay within the output bound */
+static void test_corner_bound() {
+    Clipper clipper;
+    std::mt19937 rng(12345);
+    std::uniform_int_distribution<int> corner(0, 1);
+    std::uniform_real_distribution<float> jitter(-1e-6f, 1e-6f);
+    std::uniform_real_distribution<float> far_out(-4.0f, 4.0f);
+    ClipVertex clipped[Clipper::MAX_CLIPPED_VERTICES];
+
+    bool in_bounds = true;
+    for (int i = 0; i < 100000; i++) {
+        ClipVertex v[3];
+        for (int k = 0; k < 3; k++) {
+            float w = 1.0f + jitter(rng);
+            if (k == 2) {
+                v[k] = make_vertex(far_out(rng), far_out(rng), far_out(rng), w);
+            } else {
+                /* a frustum corner, nudged by a rounding error */
+                v[k] = make_vertex((corner(rng) ? w : -w) + jitter(rng), (corner(rng) ? w : -w) + jitter(rng),
+                                   (corner(rng) ? w : -w) + jitter(rng), w);
+            }
+        }
+        int count = clipper.clip_triangle(v[0], v[1], v[2], clipped);
+        if (count < 0 || count > Clipper::MAX_CLIPPED_VERTICES || count % 3 != 0) {
+            in_bounds = false;
+        }
+    }
+    check(in_bounds, "clip_triangle output exceeds MAX_CLIPPED_VERTICES");
+}
+
+int main() {
+    test_no_allocations();
+    test_corner_bound();
+
+    if (failures > 0) {
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "clipper_test passed" << std::endl;
+    return 0;
+}
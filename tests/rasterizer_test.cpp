@@ -0,0 +1,135 @@
+#include "framebuffer.h"
+#include "pipeline/rasterizer.h"
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+static const int WIDTH = 64;
+static const int HEIGHT = 64;
+
+static int failures = 0;
+
+static void check(bool condition, const char* what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+struct VertexColorShader {
+    Color operator()(const Fragment& frag) const {
+        return frag.color;
+    }
+};
+
+static RasterVertex make_vertex(float x, float y, float z, Color color) {
+    RasterVertex v;
+    v.position = Vec3(x, y, z);
+    v.world_pos = Vec3(x, y, z);
+    v.normal = Vec3(0.0f, 0.0f, 1.0f);
+    v.tex_coord = Vec2(x / WIDTH, y / HEIGHT);
+    v.color = color;
+    v.inv_w = 1.0f;
+    return v;
+}
+
+/* two triangles covering [x0, x1] x [y0, y1] at a constant depth */
+static std::vector<RasterVertex> make_quad(float x0, float y0, float x1, float y1, float z, Color color) {
+    return {
+        make_vertex(x0, y0, z, color), make_vertex(x1, y0, z, color), make_vertex(x1, y1, z, color),
+        make_vertex(x0, y0, z, color), make_vertex(x1, y1, z, color), make_vertex(x0, y1, z, color)
+    };
+}
+
+static bool same_color(Color a, Color b) {
+    return std::abs(a.r - b.r) < 1e-4f && std::abs(a.g - b.g) < 1e-4f && std::abs(a.b - b.b) < 1e-4f;
+}
+
+/* multisampled, an OIT layer behind an opaque surface is hidden, one beside it is not */
+static void test_msaa_oit_occlusion() {
+    FrameBuffer framebuffer(WIDTH, HEIGHT);
+    framebuffer.clear(Color(0.0f, 0.0f, 0.0f, 1.0f));
+    framebuffer.clear_depth(1.0f);
+
+    Rasterizer rasterizer;
+    rasterizer.set_framebuffer(&framebuffer);
+    rasterizer.set_backface_culling(false);
+    rasterizer.set_msaa_enabled(true);
+
+    Color red = Color(1.0f, 0.0f, 0.0f, 1.0f);
+    rasterizer.draw_triangles_parallel(make_quad(16.0f, 16.0f, 48.0f, 48.0f, 0.3f, red), VertexColorShader{});
+
+    rasterizer.set_depth_write(false);
+    rasterizer.begin_oit_pass();
+    rasterizer.draw_triangles_oit(make_quad(0.0f, 0.0f, 64.0f, 64.0f, 0.6f, Color(0.0f, 0.0f, 1.0f, 0.5f)), VertexColorShader{});
+    rasterizer.composite_oit();
+    rasterizer.resolve_msaa();
+
+    check(same_color(framebuffer.get_pixel(32, 32), red), "OIT layer behind the opaque quad was blended over it");
+    check(framebuffer.get_pixel(4, 4).b > 0.0f, "OIT layer beside the opaque quad is missing");
+}
+
+/* two sloped, interpenetrating triangles with edges crossing pixels at odd angles */
+static std::vector<RasterVertex> make_crossing_triangles() {
+    return {
+        make_vertex(3.2f, 5.7f, 0.2f, Color(1.0f, 0.0f, 0.0f, 1.0f)),
+        make_vertex(60.1f, 12.3f, 0.8f, Color(0.0f, 1.0f, 0.0f, 1.0f)),
+        make_vertex(21.6f, 58.9f, 0.5f, Color(0.0f, 0.0f, 1.0f, 1.0f)),
+        make_vertex(58.4f, 2.1f, 0.3f, Color(1.0f, 1.0f, 0.0f, 1.0f)),
+        make_vertex(40.7f, 61.5f, 0.25f, Color(0.0f, 1.0f, 1.0f, 1.0f)),
+        make_vertex(1.9f, 30.2f, 0.7f, Color(1.0f, 0.0f, 1.0f, 1.0f))
+    };
+}
+
+/* multisampled render of the crossing triangles, forward or after a depth prepass */
+static std::vector<Color> render_msaa(bool prepass) {
+    FrameBuffer framebuffer(WIDTH, HEIGHT);
+    framebuffer.clear(Color(0.0f, 0.0f, 0.0f, 1.0f));
+    framebuffer.clear_depth(1.0f);
+
+    Rasterizer rasterizer;
+    rasterizer.set_framebuffer(&framebuffer);
+    rasterizer.set_backface_culling(false);
+    rasterizer.set_msaa_enabled(true);
+
+    std::vector<RasterVertex> vertices = make_crossing_triangles();
+    if (prepass) {
+        std::vector<Vec3> positions;
+        for (const RasterVertex& v : vertices) {
+            positions.push_back(v.position);
+        }
+        rasterizer.draw_depth_only(positions);
+        rasterizer.set_depth_func(DepthFunc::EQUAL);
+        rasterizer.set_depth_write(false);
+    }
+    rasterizer.draw_triangles_parallel(vertices, VertexColorShader{});
+    rasterizer.resolve_msaa();
+    return framebuffer.get_color_buffer();
+}
+
+/* multisampled, a depth prepass followed by EQUAL draws gives the forward image */
+static void test_msaa_depth_prepass() {
+    std::vector<Color> forward = render_msaa(false);
+    std::vector<Color> prepass = render_msaa(true);
+
+    bool identical = true;
+    bool drawn = false;
+    for (size_t i = 0; i < forward.size(); i++) {
+        identical = identical && forward[i] == prepass[i];
+        drawn = drawn || forward[i] != Color(0.0f, 0.0f, 0.0f, 1.0f);
+    }
+    check(drawn, "forward MSAA render is empty");
+    check(identical, "MSAA depth prepass differs from forward MSAA");
+}
+
+int main() {
+    test_msaa_oit_occlusion();
+    test_msaa_depth_prepass();
+
+    if (failures > 0) {
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "rasterizer_test passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include "thread_pool.h"
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+static int failures = 0;
+
+static void check(bool condition, const char* what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+/* every index runs exactly once and no body is still running once parallel_for returns */
+static void run_job(ThreadPool& pool, size_t count, size_t grain) {
+    std::vector<std::atomic<int>> hits(count);
+    std::atomic<int> active(0);
+    std::atomic<bool> bad_thread_id(false);
+    int threads = pool.get_num_threads();
+
+    pool.parallel_for(count, grain, [&](size_t begin, size_t end, int thread_id) {
+        active++;
+        if (thread_id < 0 || thread_id >= threads) bad_thread_id = true;
+        for (size_t i = begin; i < end; i++) {
+            hits[i]++;
+        }
+        /* long enough that the workers, not just the caller, pick up tasks */
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+        active--;
+    });
+
+    check(active.load() == 0, "a body was still running after parallel_for returned");
+    check(!bad_thread_id.load(), "thread_id out of range");
+    bool exactly_once = true;
+    for (size_t i = 0; i < count; i++) {
+        if (hits[i].load() != 1) exactly_once = false;
+    }
+    check(exactly_once, "every index runs exactly once");
+}
+
+/* workers spawned by resize() must not treat the previous job as a new one */
+static void test_resize_between_jobs() {
+    ThreadPool pool(4);
+    for (int round = 0; round < 100; round++) {
+        run_job(pool, 64, 1);
+        pool.resize(2 + round % 5);
+        run_job(pool, 64, 1);
+    }
+}
+
+/* nested jobs run inline and report the id of the thread that issued them */
+static void test_nested_thread_id() {
+    ThreadPool pool(4);
+    std::atomic<bool> mismatch(false);
+    pool.parallel_for(64, 1, [&](size_t, size_t, int outer_id) {
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        pool.parallel_for(8, 1, [&](size_t, size_t, int inner_id) {
+            if (inner_id != outer_id) mismatch = true;
+        });
+    });
+    check(!mismatch.load(), "nested job keeps the caller's thread_id");
+}
+
+int main() {
+    test_resize_between_jobs();
+    test_nested_thread_id();
+
+    if (failures > 0) {
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "thread_pool_test passed" << std::endl;
+    return 0;
+}